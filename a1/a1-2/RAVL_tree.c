@@ -4,8 +4,105 @@
  *  Based on materials developed by F. Estrada.
  */
 
+#define _POSIX_C_SOURCE 200809L  // ftruncate, fsync, posix_madvise
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "RAVL_tree.h"
 
+#ifdef RAVL_STATS
+static RAVL_Stats stats;
+#define COUNT(field) (stats.field++)
+#define COUNT_N(field, n) (stats.field += (unsigned long)(n))
+#define COUNT_DEPTH(depth) (stats.depthHistogram[depth]++)
+#else
+#define COUNT(field) ((void)0)
+#define COUNT_N(field, n) ((void)(n))
+#define COUNT_DEPTH(depth) ((void)(depth))
+#endif
+
+/*************************************************************************
+ ** Node arenas
+ *************************************************************************/
+
+#define MAX_SLAB_SIZE 65536
+
+RAVL_Arena* newArena(int initialSlabSize) {
+  RAVL_Arena* arena = (RAVL_Arena*)malloc(sizeof(RAVL_Arena));
+  if (arena == NULL) {
+    fprintf(stderr, "Memory allocation failed for RAVL_Arena\n");
+    exit(1);
+  }
+  arena->slabs = NULL;
+  arena->freeList = NULL;
+  arena->nextSlabSize = initialSlabSize > 0 ? initialSlabSize : 1;
+  return arena;
+}
+
+void deleteArena(RAVL_Arena* arena) {
+  if (arena == NULL) {
+    return;
+  }
+  RAVL_Slab* slab = arena->slabs;
+  while (slab != NULL) {
+    RAVL_Slab* next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  free(arena);
+}
+
+/* Returns an uninitialized node taken from the free list of 'arena', or from
+ * its newest slab, allocating a new slab if needed. Falls back to malloc if
+ * 'arena' is NULL.
+ */
+RAVL_Node* allocNode(RAVL_Arena* arena) {
+  if (arena == NULL) {
+    return (RAVL_Node*)malloc(sizeof(RAVL_Node));
+  }
+  if (arena->freeList != NULL) {
+    RAVL_Node* node = arena->freeList;
+    arena->freeList = node->left;
+    return node;
+  }
+  RAVL_Slab* slab = arena->slabs;
+  if (slab == NULL || slab->used == slab->capacity) {
+    int capacity = arena->nextSlabSize;
+    slab = (RAVL_Slab*)malloc(sizeof(RAVL_Slab) +
+                              (size_t)capacity * sizeof(RAVL_Node));
+    if (slab == NULL) {
+      fprintf(stderr, "Memory allocation failed for RAVL_Slab\n");
+      exit(1);
+    }
+    slab->next = arena->slabs;
+    slab->capacity = capacity;
+    slab->used = 0;
+    arena->slabs = slab;
+    if (capacity <= MAX_SLAB_SIZE / 2) {
+      arena->nextSlabSize = capacity * 2;
+    }
+  }
+  return &slab->nodes[slab->used++];
+}
+
+/* Returns 'node' to the free list of 'arena', or frees it if 'arena' is
+ * NULL.
+ */
+void releaseNode(RAVL_Arena* arena, RAVL_Node* node) {
+  if (arena == NULL) {
+    free(node);
+    return;
+  }
+  node->left = arena->freeList;
+  arena->freeList = node;
+}
+
 /*************************************************************************
  ** Suggested helper functions
  *************************************************************************/
@@ -47,8 +144,28 @@ void updateHeight(RAVL_Node* node) {
   }
 }
 
+#ifdef RAVL_AUGMENT
+/* The augmentation maintained alongside sizes; NULL if there is none. */
+const RAVL_Augment* activeAugment = NULL;
+#define AUGMENTED (activeAugment != NULL)
+
+/* Returns the aggregate of the tree rooted at node 'node' under the active
+ * augmentation. Returns the identity if 'node' is NULL.
+ */
+long long aggregate(RAVL_Node* node) {
+  if (node == NULL) {
+    return activeAugment->identity;
+  }
+  return node->aggregate;
+}
+#else
+#define AUGMENTED false
+#endif
+
 /* Updates the size of the tree rooted at node 'node' based on the sizes
- * of its children. Note: this should be an O(1) operation.
+ * of its children and its own count, along with its aggregate if an
+ * augmentation is active.
+ * Note: this should be an O(1) operation.
  */
 void updateSize(RAVL_Node* node) {
   if (node == NULL) {
@@ -56,7 +173,15 @@ void updateSize(RAVL_Node* node) {
   }
   int lcs = size(node->left);
   int rcs = size(node->right);
-  node->size = lcs + rcs + 1;
+  node->size = lcs + rcs + node->count;
+#ifdef RAVL_AUGMENT
+  if (activeAugment != NULL) {
+    long long self = activeAugment->measure(node);
+    node->aggregate = activeAugment->combine(
+        activeAugment->combine(aggregate(node->left), self),
+        aggregate(node->right));
+  }
+#endif
 }
 
 /* Returns the balance factor (height of left subtree - height of right
@@ -78,6 +203,7 @@ RAVL_Node* rightRotation(RAVL_Node* node) {
   if (node == NULL || node->left == NULL) {
     return node;
   }
+  COUNT(rightRotations);
 
   RAVL_Node* xnode = node->left;
   RAVL_Node* bnode = xnode->right;
@@ -97,6 +223,7 @@ RAVL_Node* leftRotation(RAVL_Node* node) {
   if (node == NULL || node->right == NULL) {
     return node;
   }
+  COUNT(leftRotations);
 
   RAVL_Node* xnode = node->right;
   RAVL_Node* bnode = xnode->left;
@@ -123,6 +250,7 @@ RAVL_Node* rightLeftRotation(RAVL_Node* node) {
   if (ynode == NULL) {
     return node;
   }
+  COUNT(rightLeftRotations);
 
   xnode->left = ynode->right;
   ynode->right = xnode;
@@ -150,6 +278,7 @@ RAVL_Node* leftRightRotation(RAVL_Node* node) {
   if (ynode == NULL) {
     return node;
   }
+  COUNT(leftRightRotations);
 
   xnode->right = ynode->left;
   ynode->left = xnode;
@@ -180,20 +309,32 @@ RAVL_Node* successor(RAVL_Node* node) {
   return suc;
 }
 
-/* Creates and returns an RAVL tree node with key 'key', value 'value', height
+/* Creates and returns an RAVL tree node allocated from 'arena' (or with
+ * malloc, if 'arena' is NULL) with key 'key', value 'value', count, height
  * and size of 1, and left and right subtrees NULL.
  */
-RAVL_Node* createNode(int key, void* value) {
-  RAVL_Node* newNode = (RAVL_Node*)malloc(sizeof(RAVL_Node));
+RAVL_Node* createNodeInArena(RAVL_Arena* arena, int key, void* value) {
+  RAVL_Node* newNode = allocNode(arena);
   newNode->key = key;
+  newNode->count = 1;
   newNode->value = value;
   newNode->height = 1;
   newNode->size = 1;
   newNode->left = NULL;
   newNode->right = NULL;
+  if (AUGMENTED) {
+    updateSize(newNode);
+  }
   return newNode;
 }
 
+/* Creates and returns an RAVL tree node with key 'key', value 'value', height
+ * and size of 1, and left and right subtrees NULL.
+ */
+RAVL_Node* createNode(int key, void* value) {
+  return createNodeInArena(NULL, key, value);
+}
+
 /**
  * Rebalance the 'node' and returns the pointer to the root of the new tree
  */
@@ -223,6 +364,47 @@ RAVL_Node* rebalance(RAVL_Node* node) {
   return node;
 }
 
+/* The balance policy maintained by inserts and deletes. */
+RAVL_Balance activeBalance = RAVL_BALANCE_AVL;
+
+/* Weight-balance parameters: a subtree may weigh at most WEIGHT_DELTA times
+ * its sibling, where a subtree of size s weighs s + 1, and a double rotation
+ * is needed when the inner grandchild weighs at least WEIGHT_GAMMA times the
+ * outer one.
+ */
+#define WEIGHT_DELTA 3
+#define WEIGHT_GAMMA 2
+
+/**
+ * Rebalance the 'node' by weight and returns the pointer to the root of the
+ * new tree
+ */
+RAVL_Node* rebalanceWeight(RAVL_Node* node) {
+  if (node == NULL) {
+    return node;
+  }
+
+  long long lw = (long long)size(node->left) + 1;
+  long long rw = (long long)size(node->right) + 1;
+
+  if (lw > WEIGHT_DELTA * rw) {
+    RAVL_Node* xnode = node->left;
+    if (size(xnode->right) + 1 < WEIGHT_GAMMA * (size(xnode->left) + 1LL)) {
+      return rightRotation(node);
+    }
+    return leftRightRotation(node);
+  }
+
+  if (rw > WEIGHT_DELTA * lw) {
+    RAVL_Node* xnode = node->right;
+    if (size(xnode->left) + 1 < WEIGHT_GAMMA * (size(xnode->right) + 1LL)) {
+      return leftRotation(node);
+    }
+    return rightLeftRotation(node);
+  }
+  return node;
+}
+
 /*************************************************************************
  ** Provided functions
  *************************************************************************/
@@ -250,95 +432,1666 @@ void deleteTree(RAVL_Node* node) {
  *************************************************************************/
 
 RAVL_Node* search(RAVL_Node* node, int key) {
-  if (node == NULL) {
-    return NULL;
+  int depth = 0;
+  while (node != NULL && node->key != key) {
+    node = key < node->key ? node->left : node->right;
+    depth++;
   }
-  if (node->key == key) {
-    return node;
+  COUNT(searches);
+  COUNT_N(comparisons, depth + (node != NULL));
+  COUNT_DEPTH(depth + (node != NULL));
+  return node;
+}
+
+/* Passed to retrace when the sizes along the path changed by different
+ * amounts, so they have to be recomputed from the children.
+ */
+#define RECOMPUTE_SIZES INT_MIN
+
+/* Restores heights, sizes and balance along the root-to-leaf 'path' of
+ * 'depth' links, after the subtree below the last link gained or lost
+ * 'sizeDelta' keys (positive or negative), or just changed a value or count
+ * in place ('sizeDelta' is 0, or the count change itself). Under AVL balance,
+ * once a subtree's height is unchanged no ancestor can be out of balance, so
+ * only their sizes (and aggregates) are adjusted; under weight balance every
+ * ancestor's weight changed, so all of them are rebalanced. Returns the
+ * index of the topmost link that was rebalanced; the subtrees below
+ * path[0..index) keep their shape.
+ */
+int retrace(RAVL_Node** path[], int depth, int sizeDelta) {
+  while (depth > 0) {
+    RAVL_Node** link = path[--depth];
+    RAVL_Node* node = *link;
+    int oldHeight = node->height;
+    updateHeight(node);
+    updateSize(node);
+    if (activeBalance == RAVL_BALANCE_WEIGHT) {
+      *link = rebalanceWeight(node);
+    } else {
+      *link = rebalance(node);
+    }
+    if (*link != node && sizeDelta > 0) {
+      COUNT(insertRebalances);
+    } else if (*link != node && sizeDelta < 0) {
+      COUNT(deleteRebalances);
+    }
+    if (activeBalance == RAVL_BALANCE_AVL && (*link)->height == oldHeight) {
+      break;
+    }
+  }
+  int top = depth;
+  while (depth > 0) {
+    RAVL_Node* node = *path[--depth];
+    if (AUGMENTED || sizeDelta == RECOMPUTE_SIZES) {
+      updateSize(node);
+    } else {
+      node->size += sizeDelta;
+    }
   }
+  return top;
+}
 
-  if (key < node->key) {
-    return search(node->left, key);
+/* Inserts 'key'/'value' into the tree rooted at 'node', allocating from
+ * 'arena'. If 'key' is already there its value is updated, and its count
+ * incremented if 'addCopy' is true.
+ */
+RAVL_Node* insertKey(RAVL_Arena* arena, RAVL_Node* node, int key,
+                     void* value, bool addCopy) {
+  RAVL_Node** path[RAVL_MAX_HEIGHT];
+  int depth = 0;
+  RAVL_Node* root = node;
+  RAVL_Node** link = &root;
+
+  while (*link != NULL) {
+    node = *link;
+    if (node->key == key) {
+      node->value = value;
+      if (addCopy || AUGMENTED) {
+        int sizeDelta = addCopy ? 1 : 0;
+        node->count += sizeDelta;
+        updateSize(node);
+        retrace(path, depth, sizeDelta);
+      }
+      return root;
+    }
+    path[depth++] = link;
+    link = key < node->key ? &node->left : &node->right;
   }
-  return search(node->right, key);
+  *link = createNodeInArena(arena, key, value);
+  COUNT(inserts);
+  COUNT_DEPTH(depth + 1);
+
+  retrace(path, depth, 1);
+  return root;
 }
 
 RAVL_Node* insert(RAVL_Node* node, int key, void* value) {
+  return insertKey(NULL, node, key, value, false);
+}
+
+RAVL_Node* insertInArena(RAVL_Arena* arena, RAVL_Node* node, int key,
+                         void* value) {
+  return insertKey(arena, node, key, value, false);
+}
+
+/* Deletes the node with key 'key' from the tree rooted at 'node', returning
+ * it to 'arena'. If 'oneCopy' is true and the node holds several copies,
+ * only its count is decremented.
+ */
+RAVL_Node* deleteKey(RAVL_Arena* arena, RAVL_Node* node, int key,
+                     bool oneCopy) {
+  RAVL_Node** path[RAVL_MAX_HEIGHT];
+  int depth = 0;
+  RAVL_Node* root = node;
+  RAVL_Node** link = &root;
+
+  while (*link != NULL && (*link)->key != key) {
+    node = *link;
+    path[depth++] = link;
+    link = key < node->key ? &node->left : &node->right;
+  }
+  if (*link == NULL) {
+    return root;
+  }
+
+  node = *link;
+  if (oneCopy && node->count > 1) {
+    node->count--;
+    updateSize(node);
+    retrace(path, depth, -1);
+    return root;
+  }
+  int sizeDelta = -node->count;
+  if (node->left != NULL && node->right != NULL) {
+    // replace by successor, then unlink the successor from the right subtree
+    path[depth++] = link;
+    link = &node->right;
+    while ((*link)->left != NULL) {
+      path[depth++] = link;
+      link = &(*link)->left;
+    }
+    RAVL_Node* suc = *link;
+    if (suc->count != node->count) {
+      // the nodes between 'node' and 'suc' lose suc->count keys instead
+      sizeDelta = RECOMPUTE_SIZES;
+    }
+    node->key = suc->key;
+    node->count = suc->count;
+    node->value = suc->value;
+    node = suc;
+  }
+  *link = node->left != NULL ? node->left : node->right;
+  releaseNode(arena, node);
+  COUNT(deletes);
+  COUNT_DEPTH(depth + 1);
+
+  retrace(path, depth, sizeDelta);
+  return root;
+}
+
+RAVL_Node* delete(RAVL_Node* node, int key) {
+  return deleteKey(NULL, node, key, false);
+}
+
+RAVL_Node* deleteInArena(RAVL_Arena* arena, RAVL_Node* node, int key) {
+  return deleteKey(arena, node, key, false);
+}
+
+int rank(RAVL_Node* node, int key) {
+  int r = 0;
+  while (node != NULL) {
+    if (node->key == key) {
+      return r + size(node->left) + 1;
+    }
+    if (node->key < key) {
+      r += size(node->left) + node->count;
+      node = node->right;
+    } else {
+      node = node->left;
+    }
+  }
+  return NOTIN;
+}
+
+/* Returns the number of keys in the tree rooted at 'node' that are smaller
+ * than 'key', or smaller than or equal to it if 'inclusive' is true,
+ * counting copies.
+ */
+int countBelow(RAVL_Node* node, int key, bool inclusive) {
+  int count = 0;
+  while (node != NULL) {
+    if (node->key < key || (inclusive && node->key == key)) {
+      count += size(node->left) + node->count;
+      node = node->right;
+    } else {
+      node = node->left;
+    }
+  }
+  return count;
+}
+
+int rankLowerBound(RAVL_Node* node, int key) {
+  return countBelow(node, key, false) + 1;
+}
+
+RAVL_Node* findRank(RAVL_Node* node, int rank) {
+  if (rank <= 0) {
+    return NULL;
+  }
+  while (node != NULL) {
+    int rank_root = size(node->left) + 1;
+    if (rank_root > rank) {
+      node = node->left;
+    } else if (rank < rank_root + node->count) {
+      return node;
+    } else {
+      rank -= rank_root + node->count - 1;
+      node = node->right;
+    }
+  }
+  return NULL;
+}
+
+int countRange(RAVL_Node* node, int lo, int hi) {
+  if (lo > hi) {
+    return 0;
+  }
+  return countBelow(node, hi, true) - countBelow(node, lo, false);
+}
+
+void forEachInRange(RAVL_Node* node, int lo, int hi, RAVL_Visitor visit,
+                    void* context) {
   if (node == NULL) {
-    return createNode(key, value);
+    return;
   }
-  if (node->key == key) {
-    node->value = value;
-    return node;
+  if (lo < node->key) {
+    forEachInRange(node->left, lo, hi, visit, context);
   }
-  if (key < node->key) {
-    node->left = insert(node->left, key, value);
-  } else {
-    node->right = insert(node->right, key, value);
+  if (lo <= node->key && node->key <= hi) {
+    visit(node, context);
+  }
+  if (node->key < hi) {
+    forEachInRange(node->right, lo, hi, visit, context);
   }
+}
 
-  updateHeight(node);
+/*************************************************************************
+ ** Multisets
+ *************************************************************************/
+
+/* Returns the number of nodes, i.e. distinct keys, in the tree rooted at
+ * 'node'. Unlike its size, this takes O(n).
+ */
+int countNodes(RAVL_Node* node) {
+  if (node == NULL) {
+    return 0;
+  }
+  return countNodes(node->left) + 1 + countNodes(node->right);
+}
+
+RAVL_Node* insertCopy(RAVL_Node* node, int key, void* value) {
+  return insertKey(NULL, node, key, value, true);
+}
+
+RAVL_Node* deleteCopy(RAVL_Node* node, int key) {
+  return deleteKey(NULL, node, key, true);
+}
+
+RAVL_Node* insertCopyInArena(RAVL_Arena* arena, RAVL_Node* node, int key,
+                             void* value) {
+  return insertKey(arena, node, key, value, true);
+}
+
+RAVL_Node* deleteCopyInArena(RAVL_Arena* arena, RAVL_Node* node, int key) {
+  return deleteKey(arena, node, key, true);
+}
+
+/*************************************************************************
+ ** Augmentations
+ *************************************************************************/
+
+#ifdef RAVL_AUGMENT
+void setAugment(const RAVL_Augment* augment) {
+  if (augment == NULL ||
+      (activeAugment != NULL && activeAugment != augment)) {
+    fprintf(stderr, "The augmentation can only be set once\n");
+    exit(1);
+  }
+  activeAugment = augment;
+}
+
+void refreshAggregates(RAVL_Node* node) {
+  if (node == NULL) {
+    return;
+  }
+  refreshAggregates(node->left);
+  refreshAggregates(node->right);
   updateSize(node);
+}
 
-  return rebalance(node);
+long long prefixAggregate(RAVL_Node* node, int key) {
+  long long acc = activeAugment->identity;
+  while (node != NULL) {
+    if (node->key <= key) {
+      acc = activeAugment->combine(acc, aggregate(node->left));
+      acc = activeAugment->combine(acc, activeAugment->measure(node));
+      node = node->right;
+    } else {
+      node = node->left;
+    }
+  }
+  return acc;
 }
 
-RAVL_Node* delete(RAVL_Node* node, int key) {
+long long rangeAggregate(RAVL_Node* node, int lo, int hi) {
+  const RAVL_Augment* aug = activeAugment;
+  // find the topmost node inside [lo, hi]; everything in range is below it
+  while (node != NULL && (node->key < lo || node->key > hi)) {
+    node = node->key < lo ? node->right : node->left;
+  }
   if (node == NULL) {
+    return aug->identity;
+  }
+
+  // keys in [lo, node->key), collected right to left
+  long long leftAcc = aug->identity;
+  RAVL_Node* cur = node->left;
+  while (cur != NULL) {
+    if (cur->key >= lo) {
+      leftAcc = aug->combine(aggregate(cur->right), leftAcc);
+      leftAcc = aug->combine(aug->measure(cur), leftAcc);
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+
+  // keys in (node->key, hi], collected left to right
+  long long rightAcc = aug->identity;
+  cur = node->right;
+  while (cur != NULL) {
+    if (cur->key <= hi) {
+      rightAcc = aug->combine(rightAcc, aggregate(cur->left));
+      rightAcc = aug->combine(rightAcc, aug->measure(cur));
+      cur = cur->right;
+    } else {
+      cur = cur->left;
+    }
+  }
+
+  return aug->combine(aug->combine(leftAcc, aug->measure(node)), rightAcc);
+}
+
+long long combineSum(long long a, long long b) { return a + b; }
+
+long long combineMin(long long a, long long b) { return a < b ? a : b; }
+
+long long combineMax(long long a, long long b) { return a > b ? a : b; }
+#endif
+
+/*************************************************************************
+ ** Balance policies
+ *************************************************************************/
+
+void setBalance(RAVL_Balance policy) { activeBalance = policy; }
+
+/*************************************************************************
+ ** Cursors
+ *************************************************************************/
+
+void cursorSeek(RAVL_Cursor* cursor, RAVL_Node* node, int key) {
+  int depth = 0;
+  int found = 0;  // path length up to the best candidate so far
+  while (node != NULL) {
+    cursor->path[depth++] = node;
+    if (node->key == key) {
+      found = depth;
+      break;
+    }
+    if (key < node->key) {
+      found = depth;
+      node = node->left;
+    } else {
+      node = node->right;
+    }
+  }
+  cursor->depth = found;
+}
+
+/* Positions 'cursor' as cursorSeekRank does, and returns how many copies of
+ * the key it lands on have ranks below 'rank'; 0 if it is at the end.
+ */
+int seekRank(RAVL_Cursor* cursor, RAVL_Node* node, int rank) {
+  cursor->depth = 0;
+  if (rank <= 0 || rank > size(node)) {
+    return 0;
+  }
+  while (1) {
+    cursor->path[cursor->depth++] = node;
+    int rank_root = size(node->left) + 1;
+    if (rank_root > rank) {
+      node = node->left;
+    } else if (rank < rank_root + node->count) {
+      return rank - rank_root;
+    } else {
+      rank -= rank_root + node->count - 1;
+      node = node->right;
+    }
+  }
+}
+
+void cursorSeekRank(RAVL_Cursor* cursor, RAVL_Node* node, int rank) {
+  seekRank(cursor, node, rank);
+}
+
+bool cursorAtEnd(RAVL_Cursor* cursor) { return cursor->depth == 0; }
+
+RAVL_Node* cursorNode(RAVL_Cursor* cursor) {
+  if (cursor->depth == 0) {
     return NULL;
   }
-  if (node->key == key) {
-    if (node->left == NULL) {
-      RAVL_Node* root = node->right;
-      free(node);
-      return root;
+  return cursor->path[cursor->depth - 1];
+}
+
+void cursorNext(RAVL_Cursor* cursor) {
+  if (cursor->depth == 0) {
+    return;
+  }
+  RAVL_Node* node = cursor->path[cursor->depth - 1];
+  if (node->right != NULL) {
+    node = node->right;
+    cursor->path[cursor->depth++] = node;
+    while (node->left != NULL) {
+      node = node->left;
+      cursor->path[cursor->depth++] = node;
     }
-    if (node->right == NULL) {
-      RAVL_Node* root = node->left;
-      free(node);
-      return root;
+    return;
+  }
+  // climb until we leave a left subtree; its parent is next
+  RAVL_Node* child = NULL;
+  do {
+    child = cursor->path[--cursor->depth];
+  } while (cursor->depth > 0 &&
+           cursor->path[cursor->depth - 1]->right == child);
+}
+
+void cursorPrev(RAVL_Cursor* cursor) {
+  if (cursor->depth == 0) {
+    return;
+  }
+  RAVL_Node* node = cursor->path[cursor->depth - 1];
+  if (node->left != NULL) {
+    node = node->left;
+    cursor->path[cursor->depth++] = node;
+    while (node->right != NULL) {
+      node = node->right;
+      cursor->path[cursor->depth++] = node;
     }
-    RAVL_Node* suc = successor(node);
-    node->key = suc->key;
-    node->value = suc->value;
-    node->right = delete (node->right, suc->key);
+    return;
   }
+  // climb until we leave a right subtree; its parent is previous
+  RAVL_Node* child = NULL;
+  do {
+    child = cursor->path[--cursor->depth];
+  } while (cursor->depth > 0 &&
+           cursor->path[cursor->depth - 1]->left == child);
+}
 
-  else if (key < node->key) {
-    node->left = delete (node->left, key);
-  } else {
-    node->right = delete (node->right, key);
+int findRankRange(RAVL_Node* node, int rank, int k, int* keys,
+                  void** values) {
+  RAVL_Cursor cursor;
+  int skip = seekRank(&cursor, node, rank);
+  int copied = 0;
+  while (copied < k && !cursorAtEnd(&cursor)) {
+    RAVL_Node* cur = cursorNode(&cursor);
+    for (int c = skip; c < cur->count && copied < k; c++) {
+      keys[copied] = cur->key;
+      if (values != NULL) {
+        values[copied] = cur->value;
+      }
+      copied++;
+    }
+    skip = 0;
+    cursorNext(&cursor);
   }
+  return copied;
+}
 
-  updateHeight(node);
-  updateSize(node);
+/*************************************************************************
+ ** Finger search
+ *************************************************************************/
 
-  return rebalance(node);
+/* Bounds of the finger's root link, strictly outside every int key. */
+#define FINGER_LO ((long long)INT_MIN - 1)
+#define FINGER_HI ((long long)INT_MAX + 1)
+
+/* Climbs 'finger' until the subtree below its last link spans 'key', then
+ * descends towards 'key'. Returns the link that holds 'key', or the empty
+ * link where it would be inserted. The finger ends at the link holding
+ * 'key', or at the link of the empty link's parent.
+ */
+RAVL_Node** fingerSeek(RAVL_Finger* finger, int key) {
+  while (finger->depth > 1 && (key <= finger->lo[finger->depth - 1] ||
+                               key >= finger->hi[finger->depth - 1])) {
+    finger->depth--;
+  }
+  int d = finger->depth - 1;
+  RAVL_Node** link = finger->path[d];
+  while (*link != NULL && (*link)->key != key) {
+    RAVL_Node* node = *link;
+    long long lo = finger->lo[d];
+    long long hi = finger->hi[d];
+    if (key < node->key) {
+      link = &node->left;
+      hi = node->key;
+    } else {
+      link = &node->right;
+      lo = node->key;
+    }
+    if (*link == NULL) {
+      break;
+    }
+    d = finger->depth++;
+    finger->path[d] = link;
+    finger->lo[d] = lo;
+    finger->hi[d] = hi;
+  }
+  return link;
 }
 
-int rank(RAVL_Node* node, int key) {
-  if (node == NULL || search(node, key) == NULL) {
-    return NOTIN;
+void fingerInit(RAVL_Finger* finger, RAVL_Node* node, RAVL_Arena* arena) {
+  finger->root = node;
+  finger->arena = arena;
+  finger->path[0] = &finger->root;
+  finger->lo[0] = FINGER_LO;
+  finger->hi[0] = FINGER_HI;
+  finger->depth = 1;
+  fingerSeek(finger, INT_MAX);
+}
+
+RAVL_Node* fingerSearch(RAVL_Finger* finger, int key) {
+  return *fingerSeek(finger, key);
+}
+
+void fingerInsert(RAVL_Finger* finger, int key, void* value) {
+  RAVL_Node** link = fingerSeek(finger, key);
+  // the links strictly above 'link' are the ones retrace must visit
+  int above = finger->depth;
+  if (link == finger->path[finger->depth - 1]) {
+    above--;
   }
-  if (node->key == key) {
-    return size(node->left) + 1;
+  int top = 0;
+  if (*link != NULL) {
+    (*link)->value = value;
+    if (!AUGMENTED) {
+      return;
+    }
+    updateSize(*link);
+    top = retrace(finger->path, above, 0);
+  } else {
+    *link = createNodeInArena(finger->arena, key, value);
+    COUNT(inserts);
+    COUNT_DEPTH(above + 1);
+    top = retrace(finger->path, above, 1);
   }
-  if (node->key < key) {
-    return size(node->left) + 1 + rank(node->right, key);
+  // rotations only happened at or below path[top]; find 'key' again there
+  if (finger->depth > top + 1) {
+    finger->depth = top + 1;
   }
-  return rank(node->left, key);
+  fingerSeek(finger, key);
 }
 
-RAVL_Node* findRank(RAVL_Node* node, int rank) {
-  if (node == NULL || rank <= 0) {
+/*************************************************************************
+ ** Bulk loading
+ ** Must run in O(n) for sorted input, O(n log n) otherwise.
+ *************************************************************************/
+
+typedef struct key_entry {
+  int key;      // key of this entry
+  int order;    // position of this entry in the caller's input
+  void* value;  // value associated with this entry's key
+} KeyEntry;
+
+/* Builds a perfectly balanced tree from keys[lo..hi) and values[lo..hi),
+ * allocating nodes from 'arena'.
+ */
+RAVL_Node* buildRange(RAVL_Arena* arena, int* keys, void** values, int lo,
+                      int hi) {
+  if (lo >= hi) {
     return NULL;
   }
-  int rank_root = size(node->left) + 1;
-  if (rank == rank_root) {
+  int mid = lo + (hi - lo) / 2;
+  RAVL_Node* node =
+      createNodeInArena(arena, keys[mid], values == NULL ? NULL : values[mid]);
+  node->left = buildRange(arena, keys, values, lo, mid);
+  node->right = buildRange(arena, keys, values, mid + 1, hi);
+  updateHeight(node);
+  updateSize(node);
+  return node;
+}
+
+int compareEntries(const void* a, const void* b) {
+  const KeyEntry* x = (const KeyEntry*)a;
+  const KeyEntry* y = (const KeyEntry*)b;
+  if (x->key != y->key) {
+    return x->key < y->key ? -1 : 1;
+  }
+  return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+/* Sorts the 'n' pairs keys[i]/values[i] by key into the arrays 'sortedKeys'
+ * and 'sortedValues', keeping only the last value given for each key.
+ * Returns the number of distinct keys.
+ */
+int sortUnique(int* keys, void** values, int n, int* sortedKeys,
+               void** sortedValues) {
+  KeyEntry* entries = (KeyEntry*)malloc((size_t)n * sizeof(KeyEntry));
+  if (entries == NULL) {
+    fprintf(stderr, "Memory allocation failed for the key entries\n");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++) {
+    entries[i].key = keys[i];
+    entries[i].order = i;
+    entries[i].value = values == NULL ? NULL : values[i];
+  }
+  qsort(entries, (size_t)n, sizeof(KeyEntry), compareEntries);
+
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (i + 1 < n && entries[i + 1].key == entries[i].key) {
+      continue;
+    }
+    sortedKeys[m] = entries[i].key;
+    sortedValues[m] = entries[i].value;
+    m++;
+  }
+  free(entries);
+  return m;
+}
+
+RAVL_Node* buildFromSorted(int* keys, void** values, int n) {
+  return buildRange(NULL, keys, values, 0, n);
+}
+
+RAVL_Node* buildFromUnsorted(int* keys, void** values, int n) {
+  if (n <= 0) {
+    return NULL;
+  }
+  int* sortedKeys = (int*)malloc((size_t)n * sizeof(int));
+  void** sortedValues = (void**)malloc((size_t)n * sizeof(void*));
+  if (sortedKeys == NULL || sortedValues == NULL) {
+    fprintf(stderr, "Memory allocation failed for the sorted input\n");
+    exit(1);
+  }
+  int m = sortUnique(keys, values, n, sortedKeys, sortedValues);
+  RAVL_Node* root = buildRange(NULL, sortedKeys, sortedValues, 0, m);
+  free(sortedKeys);
+  free(sortedValues);
+  return root;
+}
+
+/*************************************************************************
+ ** Parallel construction and queries
+ *************************************************************************/
+
+/* Below this many keys per thread, starting another thread costs more than
+ * it saves.
+ */
+#define PARALLEL_CUTOFF 16384
+
+typedef struct build_job {
+  int* keys;         // sorted keys of the whole input
+  void** values;     // values of the whole input, or NULL
+  int lo;            // this job builds keys[lo..hi)
+  int hi;
+  int threads;       // threads available to this job, counting its own
+  RAVL_Node* root;   // the built subtree
+} BuildJob;
+
+typedef struct query_job {
+  RAVL_Node* root;      // tree being queried
+  KeyEntry* entries;    // this job's queries, sorted by key
+  int count;            // number of entries
+  int* ranks;           // rank of the query at 'order' goes to ranks[order],
+                        //   unless NULL
+  RAVL_Node** results;  // node found for it goes to results[order], unless
+                        //   NULL
+} QueryJob;
+
+void* buildJob(void* arg) {
+  BuildJob* job = (BuildJob*)arg;
+  if (job->threads <= 1 || job->hi - job->lo < 2 * PARALLEL_CUTOFF) {
+    job->root = buildRange(NULL, job->keys, job->values, job->lo, job->hi);
+    return NULL;
+  }
+  // the midpoint is the root, exactly as in buildRange, so the shape matches
+  int mid = job->lo + (job->hi - job->lo) / 2;
+  BuildJob left = {job->keys, job->values, job->lo, mid, job->threads / 2,
+                   NULL};
+  BuildJob right = {job->keys, job->values, mid + 1, job->hi,
+                    job->threads - job->threads / 2, NULL};
+  pthread_t thread;
+  bool spawned = pthread_create(&thread, NULL, buildJob, &left) == 0;
+  if (!spawned) {
+    buildJob(&left);
+  }
+  buildJob(&right);
+  if (spawned) {
+    pthread_join(thread, NULL);
+  }
+  RAVL_Node* node = createNode(job->keys[mid],
+                               job->values == NULL ? NULL : job->values[mid]);
+  node->left = left.root;
+  node->right = right.root;
+  updateHeight(node);
+  updateSize(node);
+  job->root = node;
+  return NULL;
+}
+
+RAVL_Node* buildFromSortedParallel(int* keys, void** values, int n,
+                                   int threads) {
+  BuildJob job = {keys, values, 0, n, threads, NULL};
+  buildJob(&job);
+  return job.root;
+}
+
+void* queryJob(void* arg) {
+  QueryJob* job = (QueryJob*)arg;
+  for (int i = 0; i < job->count; i++) {
+    KeyEntry* entry = &job->entries[i];
+    if (job->ranks != NULL) {
+      job->ranks[entry->order] = rank(job->root, entry->key);
+    } else {
+      job->results[entry->order] = search(job->root, entry->key);
+    }
+  }
+  return NULL;
+}
+
+/* Sorts the 'n' queries keys[i] and answers them into 'ranks' or 'results'
+ * with up to 'threads' threads.
+ */
+void runQueries(RAVL_Node* node, int* keys, int n, int threads, int* ranks,
+                RAVL_Node** results) {
+  if (n <= 0) {
+    return;
+  }
+  if (threads > n / PARALLEL_CUTOFF) {
+    threads = n / PARALLEL_CUTOFF;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+  KeyEntry* entries = (KeyEntry*)malloc((size_t)n * sizeof(KeyEntry));
+  QueryJob* jobs = (QueryJob*)malloc((size_t)threads * sizeof(QueryJob));
+  pthread_t* workers = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
+  bool* spawned = (bool*)malloc((size_t)threads * sizeof(bool));
+  if (entries == NULL || jobs == NULL || workers == NULL || spawned == NULL) {
+    fprintf(stderr, "Memory allocation failed for the query batch\n");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++) {
+    entries[i].key = keys[i];
+    entries[i].order = i;
+    entries[i].value = NULL;
+  }
+  qsort(entries, (size_t)n, sizeof(KeyEntry), compareEntries);
+
+  for (int t = 0; t < threads; t++) {
+    int lo = (int)((long long)n * t / threads);
+    int hi = (int)((long long)n * (t + 1) / threads);
+    QueryJob job = {node, entries + lo, hi - lo, ranks, results};
+    jobs[t] = job;
+    // the caller takes the first run itself
+    spawned[t] =
+        t > 0 && pthread_create(&workers[t], NULL, queryJob, &jobs[t]) == 0;
+  }
+  for (int t = 0; t < threads; t++) {
+    if (!spawned[t]) {
+      queryJob(&jobs[t]);
+    }
+  }
+  for (int t = 0; t < threads; t++) {
+    if (spawned[t]) {
+      pthread_join(workers[t], NULL);
+    }
+  }
+  free(entries);
+  free(jobs);
+  free(workers);
+  free(spawned);
+}
+
+void rankBatch(RAVL_Node* node, int* keys, int* ranks, int n, int threads) {
+  runQueries(node, keys, n, threads, ranks, NULL);
+}
+
+void searchBatch(RAVL_Node* node, int* keys, RAVL_Node** results, int n,
+                 int threads) {
+  runQueries(node, keys, n, threads, NULL, results);
+}
+
+/*************************************************************************
+ ** Split and join
+ ** Must run in O(log n) where n is the number of nodes involved.
+ *************************************************************************/
+
+RAVL_Node* join(RAVL_Node* left, RAVL_Node* pivot, RAVL_Node* right) {
+  if (height(left) > height(right) + 1) {
+    left->right = join(left->right, pivot, right);
+    updateHeight(left);
+    updateSize(left);
+    return rebalance(left);
+  }
+  if (height(right) > height(left) + 1) {
+    right->left = join(left, pivot, right->left);
+    updateHeight(right);
+    updateSize(right);
+    return rebalance(right);
+  }
+  pivot->left = left;
+  pivot->right = right;
+  updateHeight(pivot);
+  updateSize(pivot);
+  return pivot;
+}
+
+/* Detaches the minimum node of the non-empty tree rooted at 'node' into
+ * '*min' and returns the root of the remaining tree.
+ */
+RAVL_Node* detachMin(RAVL_Node* node, RAVL_Node** min) {
+  if (node->left == NULL) {
+    *min = node;
+    RAVL_Node* rest = node->right;
+    node->right = NULL;
+    updateHeight(node);
+    updateSize(node);
+    return rest;
+  }
+  node->left = detachMin(node->left, min);
+  updateHeight(node);
+  updateSize(node);
+  return rebalance(node);
+}
+
+/* Returns the concatenation of 'left' and 'right', where every key in 'left'
+ * is smaller than every key in 'right'.
+ */
+RAVL_Node* concatTrees(RAVL_Node* left, RAVL_Node* right) {
+  if (left == NULL) {
+    return right;
+  }
+  if (right == NULL) {
+    return left;
+  }
+  RAVL_Node* pivot = NULL;
+  right = detachMin(right, &pivot);
+  return join(left, pivot, right);
+}
+
+RAVL_Node* split(RAVL_Node* node, int key, RAVL_Node** left,
+                 RAVL_Node** right) {
+  if (node == NULL) {
+    *left = NULL;
+    *right = NULL;
+    return NULL;
+  }
+  RAVL_Node* l = node->left;
+  RAVL_Node* r = node->right;
+  RAVL_Node* found = NULL;
+  if (key == node->key) {
+    *left = l;
+    *right = r;
+    node->left = NULL;
+    node->right = NULL;
+    updateHeight(node);
+    updateSize(node);
+    return node;
+  }
+  if (key < node->key) {
+    found = split(l, key, left, &l);
+  } else {
+    found = split(r, key, &r, right);
+  }
+  RAVL_Node* joined = join(l, node, r);
+  if (key < node->key) {
+    *right = joined;
+  } else {
+    *left = joined;
+  }
+  return found;
+}
+
+void splitAtRank(RAVL_Node* node, int rank, RAVL_Node** left,
+                 RAVL_Node** right) {
+  if (node == NULL) {
+    *left = NULL;
+    *right = NULL;
+    return;
+  }
+  RAVL_Node* l = node->left;
+  RAVL_Node* r = node->right;
+  int rank_root = size(l) + 1;
+  if (rank < rank_root) {
+    splitAtRank(l, rank, left, &l);
+    *right = join(l, node, r);
+  } else {
+    splitAtRank(r, rank - (rank_root + node->count - 1), &r, right);
+    *left = join(l, node, r);
+  }
+}
+
+/*************************************************************************
+ ** Batch updates
+ ** A batch of m keys costs O(m log(n/m + 1)) on top of sorting it.
+ *************************************************************************/
+
+/* Merges the sorted, distinct pairs keys[lo..hi)/values[lo..hi) into the
+ * tree rooted at 'node'.
+ */
+RAVL_Node* mergeSorted(RAVL_Arena* arena, RAVL_Node* node, int* keys,
+                       void** values, int lo, int hi) {
+  if (lo >= hi) {
+    return node;
+  }
+  if (node == NULL) {
+    return buildRange(arena, keys, values, lo, hi);
+  }
+  int mid = lo + (hi - lo) / 2;
+  RAVL_Node* left = NULL;
+  RAVL_Node* right = NULL;
+  RAVL_Node* pivot = split(node, keys[mid], &left, &right);
+  if (pivot == NULL) {
+    pivot = createNodeInArena(arena, keys[mid], values[mid]);
+  } else {
+    pivot->value = values[mid];
+  }
+  left = mergeSorted(arena, left, keys, values, lo, mid);
+  right = mergeSorted(arena, right, keys, values, mid + 1, hi);
+  return join(left, pivot, right);
+}
+
+/* Removes the sorted, distinct keys keys[lo..hi) from the tree rooted at
+ * 'node'.
+ */
+RAVL_Node* removeSorted(RAVL_Arena* arena, RAVL_Node* node, int* keys, int lo,
+                        int hi) {
+  if (lo >= hi || node == NULL) {
+    return node;
+  }
+  int mid = lo + (hi - lo) / 2;
+  RAVL_Node* left = NULL;
+  RAVL_Node* right = NULL;
+  RAVL_Node* found = split(node, keys[mid], &left, &right);
+  if (found != NULL) {
+    releaseNode(arena, found);
+  }
+  left = removeSorted(arena, left, keys, lo, mid);
+  right = removeSorted(arena, right, keys, mid + 1, hi);
+  return concatTrees(left, right);
+}
+
+int compareKeys(const void* a, const void* b) {
+  int x = *(const int*)a;
+  int y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+RAVL_Node* insertBatchInArena(RAVL_Arena* arena, RAVL_Node* node, int* keys,
+                              void** values, int n) {
+  if (n <= 0) {
     return node;
   }
-  if (rank_root > rank) {
-    return findRank(node->left, rank);
+  int* sortedKeys = (int*)malloc((size_t)n * sizeof(int));
+  void** sortedValues = (void**)malloc((size_t)n * sizeof(void*));
+  if (sortedKeys == NULL || sortedValues == NULL) {
+    fprintf(stderr, "Memory allocation failed for the sorted batch\n");
+    exit(1);
+  }
+  int m = sortUnique(keys, values, n, sortedKeys, sortedValues);
+  node = mergeSorted(arena, node, sortedKeys, sortedValues, 0, m);
+  free(sortedKeys);
+  free(sortedValues);
+  return node;
+}
+
+RAVL_Node* deleteBatchInArena(RAVL_Arena* arena, RAVL_Node* node, int* keys,
+                              int n) {
+  if (n <= 0 || node == NULL) {
+    return node;
+  }
+  int* sortedKeys = (int*)malloc((size_t)n * sizeof(int));
+  if (sortedKeys == NULL) {
+    fprintf(stderr, "Memory allocation failed for the sorted batch\n");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++) {
+    sortedKeys[i] = keys[i];
+  }
+  qsort(sortedKeys, (size_t)n, sizeof(int), compareKeys);
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (m == 0 || sortedKeys[m - 1] != sortedKeys[i]) {
+      sortedKeys[m++] = sortedKeys[i];
+    }
+  }
+  node = removeSorted(arena, node, sortedKeys, 0, m);
+  free(sortedKeys);
+  return node;
+}
+
+RAVL_Node* insertBatch(RAVL_Node* node, int* keys, void** values, int n) {
+  return insertBatchInArena(NULL, node, keys, values, n);
+}
+
+RAVL_Node* deleteBatch(RAVL_Node* node, int* keys, int n) {
+  return deleteBatchInArena(NULL, node, keys, n);
+}
+
+/*************************************************************************
+ ** Compact read-only layout
+ *************************************************************************/
+
+RAVL_Compact* compactFromTree(RAVL_Node* node) {
+  RAVL_Compact* tree = (RAVL_Compact*)malloc(sizeof(RAVL_Compact));
+  int n = countNodes(node);
+  RAVL_Node** queue = (RAVL_Node**)malloc(((size_t)n + 1) * sizeof(RAVL_Node*));
+  if (tree != NULL) {
+    tree->nodes = (RAVL_CompactNode*)malloc(((size_t)n + 1) *
+                                            sizeof(RAVL_CompactNode));
+    tree->heights = (uint8_t*)malloc(((size_t)n + 1) * sizeof(uint8_t));
+    tree->values = (void**)malloc(((size_t)n + 1) * sizeof(void*));
+  }
+  if (tree == NULL || queue == NULL || tree->nodes == NULL ||
+      tree->heights == NULL || tree->values == NULL) {
+    fprintf(stderr, "Memory allocation failed for RAVL_Compact\n");
+    exit(1);
+  }
+  tree->size = n;
+  tree->nodes[0].key = 0;
+  tree->nodes[0].left = 0;
+  tree->nodes[0].right = 0;
+  tree->nodes[0].size = 0;
+  tree->heights[0] = 0;
+  tree->values[0] = NULL;
+
+  // breadth-first: queue[i] is placed in slot i, and children are numbered
+  // in the order they are enqueued
+  int tail = 0;
+  if (node != NULL) {
+    queue[++tail] = node;
+  }
+  for (int slot = 1; slot <= n; slot++) {
+    RAVL_Node* cur = queue[slot];
+    RAVL_CompactNode* out = &tree->nodes[slot];
+    out->key = cur->key;
+    out->size = cur->size;
+    out->left = 0;
+    out->right = 0;
+    if (cur->left != NULL) {
+      queue[++tail] = cur->left;
+      out->left = (uint32_t)tail;
+    }
+    if (cur->right != NULL) {
+      queue[++tail] = cur->right;
+      out->right = (uint32_t)tail;
+    }
+    tree->heights[slot] = (uint8_t)cur->height;
+    tree->values[slot] = cur->value;
+  }
+  free(queue);
+  return tree;
+}
+
+RAVL_CompactNode* compactSearch(RAVL_Compact* tree, int key) {
+  RAVL_CompactNode* nodes = tree->nodes;
+  uint32_t slot = tree->size > 0 ? 1 : 0;
+  while (slot != 0 && nodes[slot].key != key) {
+    slot = key < nodes[slot].key ? nodes[slot].left : nodes[slot].right;
+  }
+  return slot == 0 ? NULL : &nodes[slot];
+}
+
+int compactRank(RAVL_Compact* tree, int key) {
+  RAVL_CompactNode* nodes = tree->nodes;
+  uint32_t slot = tree->size > 0 ? 1 : 0;
+  int r = 0;
+  while (slot != 0) {
+    RAVL_CompactNode* cur = &nodes[slot];
+    if (cur->key == key) {
+      return r + nodes[cur->left].size + 1;
+    }
+    if (cur->key < key) {
+      r += cur->size - nodes[cur->right].size;
+      slot = cur->right;
+    } else {
+      slot = cur->left;
+    }
+  }
+  return NOTIN;
+}
+
+RAVL_CompactNode* compactFindRank(RAVL_Compact* tree, int rank) {
+  RAVL_CompactNode* nodes = tree->nodes;
+  uint32_t slot = tree->size > 0 ? 1 : 0;
+  if (rank <= 0) {
+    return NULL;
+  }
+  while (slot != 0) {
+    RAVL_CompactNode* cur = &nodes[slot];
+    // a node's count is what its size adds to its children's
+    int rank_root = nodes[cur->left].size + 1;
+    int rank_last = cur->size - nodes[cur->right].size;
+    if (rank_root > rank) {
+      slot = cur->left;
+    } else if (rank <= rank_last) {
+      return cur;
+    } else {
+      rank -= rank_last;
+      slot = cur->right;
+    }
+  }
+  return NULL;
+}
+
+void* compactValue(RAVL_Compact* tree, RAVL_CompactNode* node) {
+  return tree->values[node - tree->nodes];
+}
+
+int compactHeight(RAVL_Compact* tree, RAVL_CompactNode* node) {
+  return tree->heights[node - tree->nodes];
+}
+
+void deleteCompact(RAVL_Compact* tree) {
+  if (tree == NULL) {
+    return;
+  }
+  free(tree->nodes);
+  free(tree->heights);
+  free(tree->values);
+  free(tree);
+}
+
+/*************************************************************************
+ ** Versioned trees
+ *************************************************************************/
+
+#define IDLE_EPOCH 0UL
+
+RAVL_Versioned* newVersioned(RAVL_Node* node) {
+  // sizeof is a multiple of the reader alignment, as aligned_alloc requires
+  RAVL_Versioned* tree = (RAVL_Versioned*)aligned_alloc(
+      _Alignof(RAVL_Versioned), sizeof(RAVL_Versioned));
+  if (tree == NULL) {
+    fprintf(stderr, "Memory allocation failed for RAVL_Versioned\n");
+    exit(1);
+  }
+  atomic_init(&tree->root, node);
+  atomic_init(&tree->epoch, IDLE_EPOCH + 1);
+  for (int i = 0; i < RAVL_MAX_READERS; i++) {
+    atomic_init(&tree->readers[i].epoch, IDLE_EPOCH);
+    atomic_init(&tree->readerSlots[i], false);
+  }
+  tree->oldestBatch = NULL;
+  tree->newestBatch = NULL;
+  tree->spareBatches = NULL;
+  tree->numRetired = 0;
+  return tree;
+}
+
+int registerReader(RAVL_Versioned* tree) {
+  for (int i = 0; i < RAVL_MAX_READERS; i++) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&tree->readerSlots[i], &expected,
+                                       true)) {
+      return i;
+    }
+  }
+  return NOTIN;
+}
+
+void unregisterReader(RAVL_Versioned* tree, int reader) {
+  atomic_store(&tree->readers[reader].epoch, IDLE_EPOCH);
+  atomic_store(&tree->readerSlots[reader], false);
+}
+
+RAVL_Node* readBegin(RAVL_Versioned* tree, int reader) {
+  // announce the current epoch, re-checking it so that the announcement is
+  // never older than the epoch in which we load the root
+  unsigned long epoch = atomic_load(&tree->epoch);
+  while (1) {
+    atomic_store(&tree->readers[reader].epoch, epoch);
+    unsigned long now = atomic_load(&tree->epoch);
+    if (now == epoch) {
+      break;
+    }
+    epoch = now;
+  }
+  return atomic_load(&tree->root);
+}
+
+void readEnd(RAVL_Versioned* tree, int reader) {
+  atomic_store_explicit(&tree->readers[reader].epoch, IDLE_EPOCH,
+                        memory_order_release);
+}
+
+/* Appends an empty batch for the current epoch to the retired list of
+ * 'tree', reusing a spare one if there is any, and returns it.
+ */
+RAVL_Retired* newBatch(RAVL_Versioned* tree) {
+  RAVL_Retired* batch = tree->spareBatches;
+  if (batch != NULL) {
+    tree->spareBatches = batch->next;
+  } else {
+    batch = (RAVL_Retired*)malloc(sizeof(RAVL_Retired));
+    if (batch == NULL) {
+      fprintf(stderr, "Memory allocation failed for a retired batch\n");
+      exit(1);
+    }
+    batch->nodes = NULL;
+    batch->capacity = 0;
+  }
+  batch->next = NULL;
+  batch->epoch = atomic_load(&tree->epoch);
+  batch->numNodes = 0;
+  if (tree->newestBatch == NULL) {
+    tree->oldestBatch = batch;
+  } else {
+    tree->newestBatch->next = batch;
+  }
+  tree->newestBatch = batch;
+  return batch;
+}
+
+/* Records that 'node' was unlinked from 'tree' in the current epoch. It is
+ * freed once every reader has moved past that epoch.
+ */
+void retireNode(RAVL_Versioned* tree, RAVL_Node* node) {
+  RAVL_Retired* batch = tree->newestBatch;
+  if (batch == NULL || batch->epoch != atomic_load(&tree->epoch)) {
+    batch = newBatch(tree);
+  }
+  if (batch->numNodes == batch->capacity) {
+    int capacity = batch->capacity == 0 ? 16 : 2 * batch->capacity;
+    batch->nodes = (RAVL_Node**)realloc(batch->nodes,
+                                        (size_t)capacity * sizeof(RAVL_Node*));
+    if (batch->nodes == NULL) {
+      fprintf(stderr, "Memory allocation failed for a retired batch\n");
+      exit(1);
+    }
+    batch->capacity = capacity;
+  }
+  batch->nodes[batch->numNodes++] = node;
+  tree->numRetired++;
+}
+
+/* Returns a fresh copy of 'node' and retires the original. */
+RAVL_Node* copyNode(RAVL_Versioned* tree, RAVL_Node* node) {
+  RAVL_Node* copy = allocNode(NULL);
+  *copy = *node;
+  retireNode(tree, node);
+  return copy;
+}
+
+/* Frees every retired node that no active reader can still reach. Batches
+ * are in epoch order, so this stops at the first one still in use and
+ * costs O(1) per freed node, plus one pass over the reader slots.
+ */
+void reclaimRetired(RAVL_Versioned* tree) {
+  unsigned long oldest = atomic_load(&tree->epoch);
+  for (int i = 0; i < RAVL_MAX_READERS; i++) {
+    unsigned long announced = atomic_load(&tree->readers[i].epoch);
+    if (announced != IDLE_EPOCH && announced < oldest) {
+      oldest = announced;
+    }
+  }
+  while (tree->oldestBatch != NULL && tree->oldestBatch->epoch < oldest) {
+    RAVL_Retired* batch = tree->oldestBatch;
+    for (int i = 0; i < batch->numNodes; i++) {
+      releaseNode(NULL, batch->nodes[i]);
+    }
+    tree->numRetired -= batch->numNodes;
+    tree->oldestBatch = batch->next;
+    if (tree->oldestBatch == NULL) {
+      tree->newestBatch = NULL;
+    }
+    batch->next = tree->spareBatches;
+    tree->spareBatches = batch;
+  }
+}
+
+/* Makes 'root' the latest version of 'tree', then advances the epoch and
+ * reclaims what it can.
+ */
+void publishVersion(RAVL_Versioned* tree, RAVL_Node* root) {
+  atomic_store(&tree->root, root);
+  atomic_fetch_add(&tree->epoch, 1);
+  reclaimRetired(tree);
+}
+
+/* Inserts 'key'/'value' below 'node', copying every node on the search
+ * path. Insertion rotations only involve nodes on that path, so they only
+ * ever touch fresh copies.
+ */
+RAVL_Node* persistentInsert(RAVL_Versioned* tree, RAVL_Node* node, int key,
+                            void* value) {
+  if (node == NULL) {
+    return createNode(key, value);
+  }
+  RAVL_Node* copy = copyNode(tree, node);
+  if (copy->key == key) {
+    copy->value = value;
+    updateSize(copy);
+    return copy;
+  }
+  if (key < copy->key) {
+    copy->left = persistentInsert(tree, copy->left, key, value);
+  } else {
+    copy->right = persistentInsert(tree, copy->right, key, value);
+  }
+  updateHeight(copy);
+  updateSize(copy);
+  return rebalance(copy);
+}
+
+/* Rebalances the fresh copy 'node' after a deletion below it. The rotation
+ * involves the taller child (and possibly one grandchild) on the side the
+ * deletion did not touch, so those are copied first.
+ */
+RAVL_Node* persistentRebalance(RAVL_Versioned* tree, RAVL_Node* node) {
+  int bafa = balanceFactor(node);
+  if (bafa > 1) {
+    node->left = copyNode(tree, node->left);
+    if (height(node->left->left) < height(node->left->right)) {
+      node->left->right = copyNode(tree, node->left->right);
+    }
+  } else if (bafa < -1) {
+    node->right = copyNode(tree, node->right);
+    if (height(node->right->left) > height(node->right->right)) {
+      node->right->left = copyNode(tree, node->right->left);
+    }
+  }
+  return rebalance(node);
+}
+
+/* Deletes 'key' from below 'node', copying every node on the search path.
+ * Precondition: 'key' is in the tree rooted at 'node'
+ */
+RAVL_Node* persistentDelete(RAVL_Versioned* tree, RAVL_Node* node, int key) {
+  if (node->key == key && (node->left == NULL || node->right == NULL)) {
+    RAVL_Node* child = node->left != NULL ? node->left : node->right;
+    retireNode(tree, node);
+    return child;
+  }
+  RAVL_Node* copy = copyNode(tree, node);
+  if (copy->key == key) {
+    RAVL_Node* suc = successor(copy);
+    copy->key = suc->key;
+    copy->count = suc->count;
+    copy->value = suc->value;
+    copy->right = persistentDelete(tree, copy->right, suc->key);
+  } else if (key < copy->key) {
+    copy->left = persistentDelete(tree, copy->left, key);
+  } else {
+    copy->right = persistentDelete(tree, copy->right, key);
+  }
+  updateHeight(copy);
+  updateSize(copy);
+  return persistentRebalance(tree, copy);
+}
+
+void versionedInsert(RAVL_Versioned* tree, int key, void* value) {
+  RAVL_Node* root = atomic_load(&tree->root);
+  publishVersion(tree, persistentInsert(tree, root, key, value));
+}
+
+void versionedDelete(RAVL_Versioned* tree, int key) {
+  RAVL_Node* root = atomic_load(&tree->root);
+  if (search(root, key) == NULL) {
+    return;
+  }
+  publishVersion(tree, persistentDelete(tree, root, key));
+}
+
+void deleteVersioned(RAVL_Versioned* tree) {
+  if (tree == NULL) {
+    return;
+  }
+  // no reader is left, so every batch can go
+  atomic_fetch_add(&tree->epoch, 1);
+  reclaimRetired(tree);
+  while (tree->spareBatches != NULL) {
+    RAVL_Retired* batch = tree->spareBatches;
+    tree->spareBatches = batch->next;
+    free(batch->nodes);
+    free(batch);
+  }
+  deleteTree(atomic_load(&tree->root));
+  free(tree);
+}
+
+/*************************************************************************
+ ** Snapshot files
+ *************************************************************************/
+
+/* Returns the offset of the values array in a snapshot of 'count' keys. */
+size_t snapshotValuesOffset(uint64_t count) {
+  size_t offset = sizeof(RAVL_SnapshotHeader) + count * sizeof(int32_t);
+  return (offset + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+}
+
+/* Returns the total length of a snapshot of 'count' keys. */
+size_t snapshotLength(uint64_t count) {
+  return snapshotValuesOffset(count) + count * sizeof(uint64_t);
+}
+
+/* Writes the snapshot of the tree rooted at 'node', which has 'count'
+ * nodes, into the open file 'fd' and flushes it to disk. The header goes
+ * in last, so a file cut short by a crash never carries a valid one.
+ * Returns true on success.
+ */
+bool writeSnapshot(RAVL_Node* node, uint64_t count, int fd) {
+  size_t length = snapshotLength(count);
+  if (ftruncate(fd, (off_t)length) != 0) {
+    return false;
+  }
+  char* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  int32_t* keys = (int32_t*)(base + sizeof(RAVL_SnapshotHeader));
+  uint64_t* values = (uint64_t*)(base + snapshotValuesOffset(count));
+  RAVL_Cursor cursor;
+  cursorSeekRank(&cursor, node, 1);
+  for (uint64_t i = 0; !cursorAtEnd(&cursor); i++) {
+    RAVL_Node* cur = cursorNode(&cursor);
+    keys[i] = cur->key;
+    values[i] = (uint64_t)(uintptr_t)cur->value;
+    cursorNext(&cursor);
+  }
+  bool ok = msync(base, length, MS_SYNC) == 0;
+
+  RAVL_SnapshotHeader header;
+  memcpy(header.magic, "RAVL", sizeof(header.magic));
+  header.version = RAVL_SNAPSHOT_VERSION;
+  header.count = count;
+  memcpy(base, &header, sizeof(header));
+  ok = ok && msync(base, length, MS_SYNC) == 0;
+
+  munmap(base, length);
+  return ok && fsync(fd) == 0;
+}
+
+bool saveSnapshot(RAVL_Node* node, const char* path) {
+  // write a temporary file and rename it over 'path', so that a crash
+  // leaves either the old snapshot or the new one, never a mix
+  size_t pathLength = strlen(path);
+  char* tmpPath = (char*)malloc(pathLength + sizeof(".tmp"));
+  if (tmpPath == NULL) {
+    fprintf(stderr, "Memory allocation failed for the snapshot path\n");
+    exit(1);
+  }
+  memcpy(tmpPath, path, pathLength);
+  memcpy(tmpPath + pathLength, ".tmp", sizeof(".tmp"));
+
+  bool ok = false;
+  int fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    ok = writeSnapshot(node, (uint64_t)countNodes(node), fd);
+    ok = close(fd) == 0 && ok;
+    ok = ok && rename(tmpPath, path) == 0;
+    if (!ok) {
+      unlink(tmpPath);
+    }
+  }
+  free(tmpPath);
+  return ok;
+}
+
+RAVL_Snapshot* mapSnapshot(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      (size_t)info.st_size < sizeof(RAVL_SnapshotHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t length = (size_t)info.st_size;
+  char* base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  RAVL_SnapshotHeader header;
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, "RAVL", sizeof(header.magic)) != 0 ||
+      header.version != RAVL_SNAPSHOT_VERSION || header.count > INT32_MAX ||
+      snapshotLength(header.count) != length) {
+    munmap(base, length);
+    return NULL;
+  }
+
+  RAVL_Snapshot* snapshot = (RAVL_Snapshot*)malloc(sizeof(RAVL_Snapshot));
+  if (snapshot == NULL) {
+    fprintf(stderr, "Memory allocation failed for RAVL_Snapshot\n");
+    exit(1);
+  }
+  snapshot->size = (int)header.count;
+  snapshot->keys = (const int32_t*)(base + sizeof(RAVL_SnapshotHeader));
+  snapshot->values =
+      (const uint64_t*)(base + snapshotValuesOffset(header.count));
+  snapshot->mapping = base;
+  snapshot->length = length;
+  return snapshot;
+}
+
+/* Builds a perfectly balanced tree from the entries [lo, hi) of the mapped
+ * 'snapshot'.
+ */
+RAVL_Node* buildSnapshotRange(RAVL_Snapshot* snapshot, int lo, int hi) {
+  if (lo >= hi) {
+    return NULL;
+  }
+  int mid = lo + (hi - lo) / 2;
+  RAVL_Node* node = createNode(snapshot->keys[mid],
+                               (void*)(uintptr_t)snapshot->values[mid]);
+  node->left = buildSnapshotRange(snapshot, lo, mid);
+  node->right = buildSnapshotRange(snapshot, mid + 1, hi);
+  updateHeight(node);
+  updateSize(node);
+  return node;
+}
+
+bool loadSnapshot(const char* path, RAVL_Node** node) {
+  RAVL_Snapshot* snapshot = mapSnapshot(path);
+  if (snapshot == NULL) {
+    return false;
+  }
+  posix_madvise(snapshot->mapping, snapshot->length, POSIX_MADV_SEQUENTIAL);
+  // the build trusts the order of the keys, so check it first
+  for (int i = 1; i < snapshot->size; i++) {
+    if (snapshot->keys[i - 1] >= snapshot->keys[i]) {
+      unmapSnapshot(snapshot);
+      return false;
+    }
+  }
+  *node = buildSnapshotRange(snapshot, 0, snapshot->size);
+  unmapSnapshot(snapshot);
+  return true;
+}
+
+int snapshotRank(RAVL_Snapshot* snapshot, int key) {
+  int lo = 0;
+  int hi = snapshot->size;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (snapshot->keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < snapshot->size && snapshot->keys[lo] == key) {
+    return lo + 1;
+  }
+  return NOTIN;
+}
+
+int snapshotKey(RAVL_Snapshot* snapshot, int rank) {
+  return snapshot->keys[rank - 1];
+}
+
+void* snapshotValue(RAVL_Snapshot* snapshot, int rank) {
+  return (void*)(uintptr_t)snapshot->values[rank - 1];
+}
+
+void unmapSnapshot(RAVL_Snapshot* snapshot) {
+  if (snapshot == NULL) {
+    return;
+  }
+  munmap(snapshot->mapping, snapshot->length);
+  free(snapshot);
+}
+
+/*************************************************************************
+ ** Instrumentation
+ *************************************************************************/
+
+void getStats(RAVL_Stats* out) {
+#ifdef RAVL_STATS
+  *out = stats;
+#else
+  memset(out, 0, sizeof(RAVL_Stats));
+#endif
+}
+
+void resetStats(void) {
+#ifdef RAVL_STATS
+  memset(&stats, 0, sizeof(RAVL_Stats));
+#endif
+}
+
+/*************************************************************************
+ ** Arena-backed trees
+ *************************************************************************/
+
+#define DEFAULT_SLAB_SIZE 64
+
+RAVL_Tree* newTreeInArena(RAVL_Arena* arena) {
+  RAVL_Tree* tree = (RAVL_Tree*)malloc(sizeof(RAVL_Tree));
+  if (tree == NULL) {
+    fprintf(stderr, "Memory allocation failed for RAVL_Tree\n");
+    exit(1);
+  }
+  tree->root = NULL;
+  tree->arena = arena;
+  tree->ownsArena = false;
+  return tree;
+}
+
+RAVL_Tree* newTree(void) {
+  RAVL_Tree* tree = newTreeInArena(newArena(DEFAULT_SLAB_SIZE));
+  tree->ownsArena = true;
+  return tree;
+}
+
+void treeInsert(RAVL_Tree* tree, int key, void* value) {
+  tree->root = insertInArena(tree->arena, tree->root, key, value);
+}
+
+void treeDelete(RAVL_Tree* tree, int key) {
+  tree->root = deleteInArena(tree->arena, tree->root, key);
+}
+
+void treeInsertCopy(RAVL_Tree* tree, int key, void* value) {
+  tree->root = insertCopyInArena(tree->arena, tree->root, key, value);
+}
+
+void treeDeleteCopy(RAVL_Tree* tree, int key) {
+  tree->root = deleteCopyInArena(tree->arena, tree->root, key);
+}
+
+void treeInsertBatch(RAVL_Tree* tree, int* keys, void** values, int n) {
+  tree->root = insertBatchInArena(tree->arena, tree->root, keys, values, n);
+}
+
+void treeDeleteBatch(RAVL_Tree* tree, int* keys, int n) {
+  tree->root = deleteBatchInArena(tree->arena, tree->root, keys, n);
+}
+
+void freeTree(RAVL_Tree* tree) {
+  if (tree == NULL) {
+    return;
+  }
+  if (tree->ownsArena) {
+    deleteArena(tree->arena);
   }
-  return findRank(node->right, rank - rank_root);
+  free(tree);
 }
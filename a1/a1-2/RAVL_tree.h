@@ -8,6 +8,9 @@
  *  original version of this file, so make sure you do not modify it!
  */
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -16,15 +19,161 @@
 
 #define NOTIN -1
 
+/* Upper bound on the height of any RAVL tree whose size fits in an int:
+ * an AVL tree with n nodes has height below 1.44 * log2(n + 2), and a
+ * weight-balanced one (see setBalance) below log(n + 1) / log(4/3) + 1.
+ */
+#define RAVL_MAX_HEIGHT 80
+
 typedef struct ravl_node {
   int key;                  // key stored in this node
+  int count;                // number of copies of 'key'; 1 unless the
+                            //   tree is used as a multiset
   void* value;              // value associated with this node's key
   int height;               // height of tree rooted at this node
-  int size;                 // size of tree rooted at this node
+  int size;                 // size of tree rooted at this node, counting
+                            //   every copy of every key
+#ifdef RAVL_AUGMENT
+  long long aggregate;      // active augmentation over the tree rooted at
+                            //   this node; see setAugment
+#endif
   struct ravl_node* left;   // this node's left child
   struct ravl_node* right;  // this node's right child
 } RAVL_Node;
 
+typedef struct ravl_compact_node {
+  int key;         // key stored in this node
+  uint32_t left;   // slot of this node's left child; 0 if there is none
+  uint32_t right;  // slot of this node's right child; 0 if there is none
+  int size;        // size of tree rooted at this node, counting copies
+} RAVL_CompactNode;
+
+typedef struct ravl_compact {
+  int size;                 // number of nodes; they occupy slots 1..size
+  RAVL_CompactNode* nodes;  // nodes in breadth-first order; nodes[0] is an
+                            //   empty sentinel with size 0
+  uint8_t* heights;         // heights[i] is the height of slot i's subtree
+  void** values;            // values[i] is the value associated with slot i
+} RAVL_Compact;
+
+typedef struct ravl_cursor {
+  RAVL_Node* path[RAVL_MAX_HEIGHT];  // nodes from the root down to the
+                                     //   current node
+  int depth;                         // number of nodes on 'path'; 0 iff the
+                                     //   cursor is at the end
+} RAVL_Cursor;
+
+typedef struct ravl_stats {
+  unsigned long searches;            // calls to search
+  unsigned long comparisons;         // nodes compared against by search
+  unsigned long inserts;             // calls to insert that added a node
+  unsigned long deletes;             // calls to delete that removed a node
+  unsigned long rightRotations;      // calls to rightRotation
+  unsigned long leftRotations;       // calls to leftRotation
+  unsigned long rightLeftRotations;  // calls to rightLeftRotation
+  unsigned long leftRightRotations;  // calls to leftRightRotation
+  unsigned long insertRebalances;    // rotations made while retracing inserts
+  unsigned long deleteRebalances;    // rotations made while retracing deletes
+  unsigned long depthHistogram[RAVL_MAX_HEIGHT + 1];  // depthHistogram[d] is
+                                     //   the number of searches, inserts and
+                                     //   deletes whose path had d nodes
+} RAVL_Stats;
+
+#define RAVL_SNAPSHOT_VERSION 1
+
+typedef struct ravl_snapshot_header {
+  char magic[4];     // "RAVL"
+  uint32_t version;  // RAVL_SNAPSHOT_VERSION
+  uint64_t count;    // number of key/value pairs in the file
+} RAVL_SnapshotHeader;
+
+typedef struct ravl_snapshot {
+  int size;                // number of key/value pairs
+  const int32_t* keys;     // keys in increasing order, inside the mapping
+  const uint64_t* values;  // values[i] belongs to keys[i], inside the mapping
+  void* mapping;           // start of the memory-mapped file
+  size_t length;           // length of the mapping in bytes
+} RAVL_Snapshot;
+
+#define RAVL_MAX_READERS 64
+#define RAVL_CACHE_LINE 64
+
+typedef struct ravl_reader {  // a reader slot, alone on its cache line so
+                              //   that announcing readers do not contend
+  _Alignas(RAVL_CACHE_LINE) atomic_ulong epoch;  // epoch announced by this
+                                                 //   slot; 0 if idle
+} RAVL_Reader;
+
+typedef struct ravl_retired {  // nodes retired in one epoch
+  struct ravl_retired* next;   // batch of the next later epoch
+  unsigned long epoch;         // epoch in which the nodes were unlinked
+  RAVL_Node** nodes;           // the nodes themselves
+  int numNodes;                // number of entries in 'nodes'
+  int capacity;                // allocated length of 'nodes'
+} RAVL_Retired;
+
+typedef struct ravl_versioned {
+  _Atomic(RAVL_Node*) root;   // latest published version of the tree
+  atomic_ulong epoch;         // current epoch; only the writer advances it
+  RAVL_Reader readers[RAVL_MAX_READERS];      // one per reader slot
+  atomic_bool readerSlots[RAVL_MAX_READERS];  // true iff the slot is taken;
+                                              //   on lines of their own
+  RAVL_Retired* oldestBatch;  // nodes unlinked by the writer and not yet
+                              //   freed, one batch per epoch, oldest first
+  RAVL_Retired* newestBatch;  // last batch in that list; NULL if none
+  RAVL_Retired* spareBatches;  // freed batches, kept for reuse
+  int numRetired;             // number of nodes in all batches
+} RAVL_Versioned;
+
+typedef enum ravl_balance {
+  RAVL_BALANCE_AVL,     // sibling heights differ by at most one
+  RAVL_BALANCE_WEIGHT,  // sibling sizes (plus one) within a factor of three,
+                        //   provided every node's count is 1
+} RAVL_Balance;
+
+#ifdef RAVL_AUGMENT
+typedef struct ravl_augment {
+  long long identity;                    // aggregate of an empty tree
+  long long (*measure)(RAVL_Node* node);  // contribution of a single node
+  long long (*combine)(long long a, long long b);  // associative operation;
+                                                   //   'a' precedes 'b'
+} RAVL_Augment;
+#endif
+
+/* Callback used by the traversal functions: invoked once per visited node,
+ * with the 'context' pointer given to the traversal.
+ */
+typedef void (*RAVL_Visitor)(RAVL_Node* node, void* context);
+
+typedef struct ravl_slab {  // a block of nodes carved out of one allocation
+  struct ravl_slab* next;   // the previously allocated slab
+  int capacity;             // number of nodes in this slab
+  int used;                 // number of nodes handed out from this slab
+  RAVL_Node nodes[];        // the nodes themselves
+} RAVL_Slab;
+
+typedef struct ravl_arena {
+  RAVL_Slab* slabs;      // all slabs owned by this arena, newest first
+  RAVL_Node* freeList;   // recycled nodes, chained through their 'left' field
+  int nextSlabSize;      // number of nodes in the next slab to allocate
+} RAVL_Arena;
+
+typedef struct ravl_finger {
+  RAVL_Node* root;                    // root of the tree being searched
+  RAVL_Arena* arena;                  // arena new nodes are allocated from;
+                                      //   NULL to use malloc
+  RAVL_Node** path[RAVL_MAX_HEIGHT];  // links from &root down to the finger
+  long long lo[RAVL_MAX_HEIGHT];      // every key below path[i] is > lo[i]
+  long long hi[RAVL_MAX_HEIGHT];      //   and < hi[i]
+  int depth;                          // number of links on 'path'
+} RAVL_Finger;
+
+typedef struct ravl_tree {
+  RAVL_Node* root;     // root of this tree; NULL if the tree is empty
+  RAVL_Arena* arena;   // arena that all nodes of this tree are allocated from
+  bool ownsArena;      // true iff 'arena' is freed together with this tree
+} RAVL_Tree;
+
 /* Returns the node, from the tree rooted at 'node', that contains key 'key'.
  * Returns NULL if 'key' is not in the tree.
  */
@@ -43,22 +192,520 @@ RAVL_Node* insert(RAVL_Node* node, int key, void* value);
 RAVL_Node* delete(RAVL_Node* node, int key);
 
 /* Returns the rank of the node, from the tree rooted at 'node', that
- * contains key 'key'.  Returns NOTIN if 'key' is not in the tree.
+ * contains key 'key'.  Returns NOTIN if 'key' is not in the tree. If the
+ * node holds several copies of 'key', they have consecutive ranks and the
+ * rank of the first one is returned.
  */
 int rank(RAVL_Node* node, int key);
 
-/* Returns the node, from the tree rooted at 'node', that has rank 'rank'.
- * Returns NULL if there is no node with rank 'rank' in the tree.
+/* Returns the rank that key 'key' has, or would have if it were inserted,
+ * in the tree rooted at 'node': one more than the number of keys smaller
+ * than 'key'.
+ */
+int rankLowerBound(RAVL_Node* node, int key);
+
+/* Returns the node, from the tree rooted at 'node', that has rank 'rank'
+ * (or, in a multiset, holds the copy with rank 'rank'). Returns NULL if
+ * there is no node with rank 'rank' in the tree.
  */
 RAVL_Node* findRank(RAVL_Node* node, int rank);
 
+/* Returns the number of keys 'k' in the tree rooted at 'node' with
+ * lo <= k <= hi, counting copies. Runs in O(log n).
+ */
+int countRange(RAVL_Node* node, int lo, int hi);
+
+/* Calls 'visit' on every node of the tree rooted at 'node' whose key 'k'
+ * satisfies lo <= k <= hi, in increasing key order. Runs in O(log n + m),
+ * where m is the number of visited nodes.
+ */
+void forEachInRange(RAVL_Node* node, int lo, int hi, RAVL_Visitor visit,
+                    void* context);
+
 /* Prints the keys of the RAVL tree rooted at 'node', in the in-order
  * traversal order.
  */
 void printTreeInorder(RAVL_Node* node);
 
 /* Frees all memory allocated for an RAVL tree rooted at 'node'.
+ * Precondition: the nodes of the tree were not allocated from an arena.
  */
 void deleteTree(RAVL_Node* node);
 
+/*************************************************************************
+ ** Multisets
+ ** A node may hold several copies of its key, as recorded in 'count'. The
+ ** copies count towards 'size', so rank, findRank and the other rank
+ ** queries see each one, while search, cursors and traversals visit the
+ ** node once. insert and delete still treat a key as a single node.
+ *************************************************************************/
+
+/* Adds one copy of 'key' to the RAVL tree rooted at 'node'. If 'key' is
+ * already in the tree, increments the count of its node and updates its
+ * value to 'value'; otherwise inserts it with a count of 1. Returns the
+ * root of the resulting tree.
+ */
+RAVL_Node* insertCopy(RAVL_Node* node, int key, void* value);
+
+/* Removes one copy of 'key' from the RAVL tree rooted at 'node', deleting
+ * its node once the count drops to zero. If 'key' is not a key in the tree,
+ * the tree is unchanged. Returns the root of the resulting tree.
+ */
+RAVL_Node* deleteCopy(RAVL_Node* node, int key);
+
+/*************************************************************************
+ ** Augmentations
+ ** Besides 'size', every node can carry the aggregate of a user-defined
+ ** monoid over its subtree, kept up to date wherever sizes are. They are
+ ** only available when every file that includes this header is compiled
+ ** with -DRAVL_AUGMENT; otherwise nodes have no aggregate field and tree
+ ** operations pay nothing for them.
+ *************************************************************************/
+
+#ifdef RAVL_AUGMENT
+/* Makes 'augment' the augmentation maintained by all tree operations from
+ * now on. The augmentation is shared by every tree in the program, so it
+ * can be set only once: a later call with a different 'augment' exits with
+ * an error rather than leave stale aggregates in existing trees. Trees
+ * built before the first call must be refreshed with refreshAggregates.
+ * Precondition: augment != NULL
+ */
+void setAugment(const RAVL_Augment* augment);
+
+/* Recomputes the aggregates of every node in the tree rooted at 'node'
+ * under the current augmentation. Runs in O(n).
+ */
+void refreshAggregates(RAVL_Node* node);
+
+/* Returns the aggregate over all nodes with key <= 'key' in the tree rooted
+ * at 'node', or the identity if there are none. Runs in O(log n).
+ * Precondition: an augmentation is set
+ */
+long long prefixAggregate(RAVL_Node* node, int key);
+
+/* Returns the aggregate over all nodes with lo <= key <= hi in the tree
+ * rooted at 'node', or the identity if there are none. Runs in O(log n).
+ * Precondition: an augmentation is set
+ */
+long long rangeAggregate(RAVL_Node* node, int lo, int hi);
+
+/* Ready-made 'combine' operations for RAVL_Augment. */
+long long combineSum(long long a, long long b);
+long long combineMin(long long a, long long b);
+long long combineMax(long long a, long long b);
+#endif
+
+/*************************************************************************
+ ** Balance policies
+ ** AVL balance keeps searches shortest. Weight balance (delta 3, gamma 2)
+ ** allows taller trees but rotates less often on updates. The policy
+ ** applies to insert, delete and their variants. Split, join, the batch
+ ** functions and versioned trees always rebalance as AVL and expect AVL
+ ** trees as input. The bulk builders produce perfectly balanced trees,
+ ** which satisfy both policies.
+ ** A tree must stay under the policy it was built under. Updating a
+ ** weight-balanced tree under AVL balance, or passing it to split, join
+ ** or the batch functions, leaves a tree that satisfies neither invariant,
+ ** and no later update restores them: AVL retracing stops at the first
+ ** subtree whose height did not change, and a single rotation only fixes
+ ** a node whose children were balanced. The same goes for updating an AVL
+ ** tree under weight balance. Such a tree is still a correct search tree
+ ** with correct sizes, but its height is no longer guaranteed to stay
+ ** below RAVL_MAX_HEIGHT, which the update and cursor paths rely on.
+ ** Weight balance measures subtrees by 'size', which counts every copy of
+ ** a key, and assumes each node holds one copy. Rotations cannot split a
+ ** node with many copies, so in a multiset the factor-of-three bound on
+ ** sibling sizes can be violated; use AVL balance for multisets.
+ *************************************************************************/
+
+/* Makes 'policy' the balance maintained by all subsequent inserts and
+ * deletes. The default is RAVL_BALANCE_AVL. Trees built under the previous
+ * policy must not be updated afterwards, except those that came straight
+ * from the bulk builders; see above.
+ */
+void setBalance(RAVL_Balance policy);
+
+/*************************************************************************
+ ** Cursors
+ ** A cursor remembers the path to its node, so stepping to a neighbour is
+ ** O(1) amortized and a full scan is O(n), with no allocation. Any change
+ ** to the tree invalidates its cursors.
+ *************************************************************************/
+
+/* Positions 'cursor' at the node with the smallest key >= 'key' in the tree
+ * rooted at 'node', or at the end if there is none.
+ */
+void cursorSeek(RAVL_Cursor* cursor, RAVL_Node* node, int key);
+
+/* Positions 'cursor' at the node with rank 'rank' in the tree rooted at
+ * 'node', or at the end if there is none.
+ */
+void cursorSeekRank(RAVL_Cursor* cursor, RAVL_Node* node, int rank);
+
+/* Returns true iff 'cursor' is at the end, i.e. not at any node. */
+bool cursorAtEnd(RAVL_Cursor* cursor);
+
+/* Returns the node 'cursor' is at, or NULL if it is at the end. */
+RAVL_Node* cursorNode(RAVL_Cursor* cursor);
+
+/* Moves 'cursor' to the next node in key order, or to the end if it was at
+ * the largest key. Has no effect at the end.
+ */
+void cursorNext(RAVL_Cursor* cursor);
+
+/* Moves 'cursor' to the previous node in key order, or to the end if it was
+ * at the smallest key. Has no effect at the end.
+ */
+void cursorPrev(RAVL_Cursor* cursor);
+
+/* Copies the keys with ranks 'rank'..'rank'+'k'-1 in the tree rooted at
+ * 'node', in increasing order, into 'keys', and their values into 'values'
+ * unless it is NULL; a key with several copies appears once per copy.
+ * Returns the number of keys copied, which is less than 'k' if the tree
+ * runs out. Runs in O(k + log n), with one descent from the root.
+ * Precondition: 'keys' (and 'values') have room for 'k' entries
+ */
+int findRankRange(RAVL_Node* node, int rank, int k, int* keys,
+                  void** values);
+
+/*************************************************************************
+ ** Finger search
+ ** A finger owns a tree and remembers a position in it. Searches and
+ ** inserts climb from that position only as far as needed to reach the
+ ** key. Stepping through keys in increasing order, as appends do, climbs
+ ** O(1) levels amortized, but a single search can still cost O(log n) even
+ ** for a nearby key: the key just after the root's left subtree is only
+ ** reached through the root. An insert is always O(log n), since the sizes
+ ** all the way up the remembered path change; on appends it saves the
+ ** comparisons of a descent from the root. A finger points into itself
+ ** and must not be copied. Changing the tree other than through the
+ ** finger invalidates it until the next fingerInit.
+ *************************************************************************/
+
+/* Makes 'finger' own the tree rooted at 'node', whose new nodes come from
+ * 'arena' (or from malloc, if 'arena' is NULL), and places it at the
+ * largest key, ready for appends. The root is kept in finger->root.
+ */
+void fingerInit(RAVL_Finger* finger, RAVL_Node* node, RAVL_Arena* arena);
+
+/* Returns the node of the finger's tree that contains key 'key', or NULL if
+ * 'key' is not in the tree. Leaves the finger at that node, or at the last
+ * node visited.
+ */
+RAVL_Node* fingerSearch(RAVL_Finger* finger, int key);
+
+/* Inserts 'key'/'value' into the finger's tree, as insert does, and leaves
+ * the finger at the node with key 'key'.
+ */
+void fingerInsert(RAVL_Finger* finger, int key, void* value);
+
+/*************************************************************************
+ ** Bulk loading
+ *************************************************************************/
+
+/* Returns the root of a perfectly balanced RAVL tree holding the 'n' pairs
+ * keys[i]/values[i], built in O(n). 'values' may be NULL, in which case all
+ * values are NULL.
+ * Precondition: keys[0] < keys[1] < ... < keys[n-1]
+ */
+RAVL_Node* buildFromSorted(int* keys, void** values, int n);
+
+/* Same as buildFromSorted, but 'keys' may be in any order and may repeat; as
+ * with insert, the last value given for a key wins. Runs in O(n log n): one
+ * sort followed by a linear build.
+ */
+RAVL_Node* buildFromUnsorted(int* keys, void** values, int n);
+
+/*************************************************************************
+ ** Parallel construction and queries
+ ** These spread their work over 'threads' POSIX threads, counting the
+ ** caller, and fall back to fewer if threads cannot be started or the input
+ ** is too small to be worth splitting. Link with -pthread.
+ *************************************************************************/
+
+/* Same as buildFromSorted, but the top levels of the tree are split between
+ * threads and each builds its subtrees independently.
+ * Precondition: keys[0] < keys[1] < ... < keys[n-1]
+ */
+RAVL_Node* buildFromSortedParallel(int* keys, void** values, int n,
+                                   int threads);
+
+/* Stores rank(node, keys[i]) in ranks[i], for each of the 'n' queries. The
+ * queries are sorted first and each thread answers a contiguous run of
+ * them, so consecutive searches share their upper paths in the cache.
+ * Precondition: the tree is not modified until the call returns
+ */
+void rankBatch(RAVL_Node* node, int* keys, int* ranks, int n, int threads);
+
+/* Stores search(node, keys[i]) in results[i], for each of the 'n' queries,
+ * in the same way as rankBatch. With more than one thread, the searches
+ * race on the RAVL_STATS counters, which then undercount.
+ * Precondition: the tree is not modified until the call returns
+ */
+void searchBatch(RAVL_Node* node, int* keys, RAVL_Node** results, int n,
+                 int threads);
+
+/*************************************************************************
+ ** Split and join
+ *************************************************************************/
+
+/* Returns the root of the RAVL tree holding the keys of 'left', then the key
+ * of 'pivot', then the keys of 'right'. 'pivot' must not be part of either
+ * tree; its children are overwritten. Runs in
+ * O(|height(left) - height(right)| + 1).
+ * Precondition: every key in 'left' < pivot->key < every key in 'right'
+ */
+RAVL_Node* join(RAVL_Node* left, RAVL_Node* pivot, RAVL_Node* right);
+
+/* Splits the RAVL tree rooted at 'node' into a tree of the keys smaller than
+ * 'key', stored in '*left', and a tree of the keys larger than 'key', stored
+ * in '*right'. Returns the node with key 'key', detached from both trees, or
+ * NULL if 'key' is not in the tree.
+ */
+RAVL_Node* split(RAVL_Node* node, int key, RAVL_Node** left,
+                 RAVL_Node** right);
+
+/* Splits the RAVL tree rooted at 'node' into a tree of the nodes with ranks
+ * 1..'rank', stored in '*left', and a tree of the remaining nodes, stored in
+ * '*right'. A node whose copies straddle 'rank' goes to '*left' whole.
+ */
+void splitAtRank(RAVL_Node* node, int rank, RAVL_Node** left,
+                 RAVL_Node** right);
+
+/*************************************************************************
+ ** Batch updates
+ *************************************************************************/
+
+/* Inserts the 'n' pairs keys[i]/values[i] into the RAVL tree rooted at
+ * 'node', as n calls to insert would, and returns the root of the resulting
+ * tree. The batch is sorted once and merged in with split/join, so each
+ * affected subtree is rebalanced once rather than once per key. 'values'
+ * may be NULL, in which case all values are NULL.
+ */
+RAVL_Node* insertBatch(RAVL_Node* node, int* keys, void** values, int n);
+
+/* Deletes the nodes with keys keys[0..n-1] from the RAVL tree rooted at
+ * 'node', as n calls to delete would, and returns the root of the resulting
+ * tree. Keys that are not in the tree are ignored.
+ */
+RAVL_Node* deleteBatch(RAVL_Node* node, int* keys, int n);
+
+/*************************************************************************
+ ** Compact read-only layout
+ ** A snapshot of a tree stored in one array of 16-byte nodes that refer to
+ ** their children by 32-bit slot, with heights and values kept apart.
+ *************************************************************************/
+
+/* Returns a compact copy of the tree rooted at 'node', with the same shape,
+ * laid out breadth-first so that the top levels share cache lines. Later
+ * changes to the tree are not reflected in the copy.
+ */
+RAVL_Compact* compactFromTree(RAVL_Node* node);
+
+/* Returns the node of 'tree' that contains key 'key', or NULL if 'key' is
+ * not in 'tree'.
+ */
+RAVL_CompactNode* compactSearch(RAVL_Compact* tree, int key);
+
+/* Returns the rank of key 'key' in 'tree', or NOTIN if 'key' is not in it. */
+int compactRank(RAVL_Compact* tree, int key);
+
+/* Returns the node of 'tree' that has rank 'rank', or NULL if there is no
+ * such node.
+ */
+RAVL_CompactNode* compactFindRank(RAVL_Compact* tree, int rank);
+
+/* Returns the value associated with 'node', a node of 'tree'. */
+void* compactValue(RAVL_Compact* tree, RAVL_CompactNode* node);
+
+/* Returns the height of the subtree rooted at 'node', a node of 'tree'. */
+int compactHeight(RAVL_Compact* tree, RAVL_CompactNode* node);
+
+/* Frees all memory allocated for 'tree'. */
+void deleteCompact(RAVL_Compact* tree);
+
+/*************************************************************************
+ ** Versioned trees
+ ** One writer publishes new versions by path copying; any number of
+ ** readers search a snapshot without taking locks. Versions that no reader
+ ** can still see are reclaimed by epoch.
+ *************************************************************************/
+
+/* Returns a newly created versioned tree whose first version is the tree
+ * rooted at 'node', which it takes ownership of.
+ */
+RAVL_Versioned* newVersioned(RAVL_Node* node);
+
+/* Claims a reader slot in 'tree' and returns it, or returns NOTIN if all
+ * RAVL_MAX_READERS slots are taken. Safe to call from any thread.
+ */
+int registerReader(RAVL_Versioned* tree);
+
+/* Releases reader slot 'reader' of 'tree'.
+ * Precondition: the slot is not inside a readBegin/readEnd pair
+ */
+void unregisterReader(RAVL_Versioned* tree, int reader);
+
+/* Returns the root of the latest version of 'tree'. The snapshot may be
+ * passed to search, rank, findRank and the other read-only functions, and
+ * stays valid until the matching readEnd.
+ */
+RAVL_Node* readBegin(RAVL_Versioned* tree, int reader);
+
+/* Ends the snapshot taken by reader slot 'reader' of 'tree'. */
+void readEnd(RAVL_Versioned* tree, int reader);
+
+/* Publishes a new version of 'tree' with key/value 'key'/'value' inserted,
+ * as insert does. Only one thread may write to 'tree' at a time.
+ */
+void versionedInsert(RAVL_Versioned* tree, int key, void* value);
+
+/* Publishes a new version of 'tree' without key 'key', as delete does. Only
+ * one thread may write to 'tree' at a time.
+ */
+void versionedDelete(RAVL_Versioned* tree, int key);
+
+/* Frees all memory allocated for 'tree' and all of its versions.
+ * Precondition: no reader is inside a readBegin/readEnd pair
+ */
+void deleteVersioned(RAVL_Versioned* tree);
+
+/*************************************************************************
+ ** Snapshot files
+ ** A snapshot file is a RAVL_SnapshotHeader followed by the keys in
+ ** increasing order (int32) and then, 8-byte aligned, their values (the
+ ** 64-bit pattern of each value pointer), all in host byte order. Values
+ ** only survive a round trip if they encode data rather than addresses.
+ ** Each key is stored once, so multiset counts are not preserved.
+ *************************************************************************/
+
+/* Writes the tree rooted at 'node' to the file 'path' in one in-order pass.
+ * The snapshot is written to 'path' with ".tmp" appended, flushed to disk,
+ * and then renamed over 'path', so a crash leaves the previous file intact.
+ * Returns true on success, false if the file could not be written.
+ */
+bool saveSnapshot(RAVL_Node* node, const char* path);
+
+/* Memory-maps the snapshot file 'path' and bulk-builds a tree from it in
+ * O(n), storing its root in '*node'. Returns true on success, false if the
+ * file could not be read, is not a valid snapshot, or holds keys that are
+ * not strictly increasing.
+ */
+bool loadSnapshot(const char* path, RAVL_Node** node);
+
+/* Memory-maps the snapshot file 'path' for use as a read-only index without
+ * building a tree. Returns NULL if the file could not be read or is not a
+ * valid snapshot. Only the header and length are checked, so that mapping
+ * stays O(1); the order of the keys is not.
+ */
+RAVL_Snapshot* mapSnapshot(const char* path);
+
+/* Returns the rank of key 'key' in 'snapshot', or NOTIN if it is not there.
+ * Runs in O(log n).
+ */
+int snapshotRank(RAVL_Snapshot* snapshot, int key);
+
+/* Returns the key with rank 'rank' in 'snapshot'.
+ * Precondition: 1 <= rank <= snapshot->size
+ */
+int snapshotKey(RAVL_Snapshot* snapshot, int rank);
+
+/* Returns the value of the key with rank 'rank' in 'snapshot'.
+ * Precondition: 1 <= rank <= snapshot->size
+ */
+void* snapshotValue(RAVL_Snapshot* snapshot, int rank);
+
+/* Unmaps 'snapshot' and frees its memory. */
+void unmapSnapshot(RAVL_Snapshot* snapshot);
+
+/*************************************************************************
+ ** Instrumentation
+ ** Counters are only kept when RAVL_tree.c is compiled with -DRAVL_STATS;
+ ** otherwise they compile away and read as zero. They are not synchronized,
+ ** so concurrent readers of a versioned tree, and the worker threads of
+ ** searchBatch, make them approximate: counts racing on other threads may
+ ** be lost.
+ *************************************************************************/
+
+/* Copies the counters accumulated since the last resetStats into '*stats'. */
+void getStats(RAVL_Stats* stats);
+
+/* Sets all counters to zero. */
+void resetStats(void);
+
+/*************************************************************************
+ ** Node arenas
+ *************************************************************************/
+
+/* Returns a newly created empty arena whose first slab holds
+ * 'initialSlabSize' nodes. Later slabs grow geometrically.
+ * Precondition: initialSlabSize > 0
+ */
+RAVL_Arena* newArena(int initialSlabSize);
+
+/* Frees all memory allocated for 'arena', including every node ever
+ * allocated from it. Runs in time proportional to the number of slabs, not
+ * the number of nodes.
+ */
+void deleteArena(RAVL_Arena* arena);
+
+/* Same as insert, but allocates the new node (if any) from 'arena'.
+ * Precondition: all nodes of the tree rooted at 'node' come from 'arena'
+ */
+RAVL_Node* insertInArena(RAVL_Arena* arena, RAVL_Node* node, int key,
+                         void* value);
+
+/* Same as delete, but returns the removed node to the free list of 'arena'.
+ * Precondition: all nodes of the tree rooted at 'node' come from 'arena'
+ */
+RAVL_Node* deleteInArena(RAVL_Arena* arena, RAVL_Node* node, int key);
+
+/* Same as insertCopy, but allocates the new node (if any) from 'arena'.
+ * Precondition: all nodes of the tree rooted at 'node' come from 'arena'
+ */
+RAVL_Node* insertCopyInArena(RAVL_Arena* arena, RAVL_Node* node, int key,
+                             void* value);
+
+/* Same as deleteCopy, but returns the removed node (if any) to the free list
+ * of 'arena'.
+ * Precondition: all nodes of the tree rooted at 'node' come from 'arena'
+ */
+RAVL_Node* deleteCopyInArena(RAVL_Arena* arena, RAVL_Node* node, int key);
+
+/*************************************************************************
+ ** Arena-backed trees
+ *************************************************************************/
+
+/* Returns a newly created empty tree that owns a private arena. */
+RAVL_Tree* newTree(void);
+
+/* Returns a newly created empty tree whose nodes are allocated from the
+ * caller-owned 'arena'. The arena may be shared by several trees and is not
+ * freed by freeTree.
+ */
+RAVL_Tree* newTreeInArena(RAVL_Arena* arena);
+
+/* Inserts the key/value pair 'key'/'value' into 'tree', as insert does. */
+void treeInsert(RAVL_Tree* tree, int key, void* value);
+
+/* Deletes the node with key 'key' from 'tree', as delete does. */
+void treeDelete(RAVL_Tree* tree, int key);
+
+/* Adds one copy of 'key' to 'tree', as insertCopy does. */
+void treeInsertCopy(RAVL_Tree* tree, int key, void* value);
+
+/* Removes one copy of 'key' from 'tree', as deleteCopy does. */
+void treeDeleteCopy(RAVL_Tree* tree, int key);
+
+/* Inserts a batch of key/value pairs into 'tree', as insertBatch does. */
+void treeInsertBatch(RAVL_Tree* tree, int* keys, void** values, int n);
+
+/* Deletes a batch of keys from 'tree', as deleteBatch does. */
+void treeDeleteBatch(RAVL_Tree* tree, int* keys, int n);
+
+/* Frees 'tree'. If the tree owns its arena, all of its nodes are released at
+ * once; otherwise they remain in the caller's arena until deleteArena.
+ */
+void freeTree(RAVL_Tree* tree);
+
 #endif
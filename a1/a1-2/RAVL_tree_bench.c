@@ -0,0 +1,420 @@
+/*
+ *  Microbenchmarks for our RAVL tree implementation.
+ *
+ *  Every workload draws its keys from a seeded generator, so two runs with
+ *  the same -n and -s perform exactly the same operations. Results are
+ *  printed one line per workload, as CSV (default) or JSON lines, for
+ *  tracking regressions across builds.
+ *
+ *  Compile:
+ *   gcc -O2 -Wall -Werror -pthread RAVL_tree.c RAVL_tree_bench.c -o bench -lm
+ *
+ *  Run:
+ *   ./bench [-n keys] [-s seed] [-f csv|json] [-p avl|weight] [-t threads]
+ *
+ *  -p selects the balance policy used by inserts and deletes (see
+ *  setBalance); the default is avl. -t sets the threads used by the
+ *  parallel workloads; the default is 1.
+ *
+ *  Columns:
+ *   workload, ops, ns_per_op, ops_per_sec, peak_rss_kb, checksum
+ *   (checksum depends only on the operations performed; it keeps the
+ *   compiler from discarding lookups and lets runs be compared)
+ *
+ *  peak_rss_kb is the peak resident set of the whole process so far, as
+ *  reported by getrusage. It never goes down, so a workload only shows up
+ *  in it if it raises the peak set by the ones before it.
+ *
+ *  rand_insert, rand_insert_arena and the generic-key rand_insert_int64
+ *  and rand_insert_key16 all time building the tree and tearing it down,
+ *  so the arena's bulk free is part of the comparison.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "RAVL_tree.h"
+#include "RAVL_tree_generic.h"
+
+#define DEFAULT_KEYS 1000000
+#define DEFAULT_SEED 63
+#define ZIPF_EXPONENT 0.99
+#define RANGE_CHUNK 64
+
+typedef struct bench_result {
+  const char* workload;    // name of the workload
+  long ops;                // number of tree operations performed
+  double seconds;          // wall-clock time spent on them
+  unsigned long checksum;  // combination of the operations' results
+} BenchResult;
+
+uint64_t rngState;
+bool jsonOutput = false;
+int threads = 1;
+
+/* Returns the next value of a splitmix64 generator. */
+uint64_t nextRandom(void) {
+  uint64_t z = (rngState += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* Returns a uniformly distributed value in [0, bound). */
+int randomBelow(int bound) { return (int)(nextRandom() % (uint64_t)bound); }
+
+double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+long peakRssKb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // reported in bytes on macOS
+#else
+  return usage.ru_maxrss;  // reported in kilobytes on Linux
+#endif
+}
+
+void report(BenchResult result) {
+  double nsPerOp = result.seconds * 1e9 / (double)result.ops;
+  double opsPerSec = (double)result.ops / result.seconds;
+  if (jsonOutput) {
+    printf("{\"workload\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.2f, "
+           "\"ops_per_sec\": %.0f, \"peak_rss_kb\": %ld, \"checksum\": %lu}\n",
+           result.workload, result.ops, nsPerOp, opsPerSec, peakRssKb(),
+           result.checksum);
+  } else {
+    printf("%s,%ld,%.2f,%.0f,%ld,%lu\n", result.workload, result.ops, nsPerOp,
+           opsPerSec, peakRssKb(), result.checksum);
+  }
+  fflush(stdout);
+}
+
+/* Fills 'keys' with a seeded random permutation of 0..n-1. */
+void shuffledKeys(int* keys, int n) {
+  for (int i = 0; i < n; i++) {
+    keys[i] = i;
+  }
+  for (int i = n - 1; i > 0; i--) {
+    int j = randomBelow(i + 1);
+    int tmp = keys[i];
+    keys[i] = keys[j];
+    keys[j] = tmp;
+  }
+}
+
+/* Fills 'samples' with 'count' Zipf-distributed ranks in [0, n), drawn by
+ * inverting the cumulative distribution.
+ */
+void zipfSamples(int* samples, int count, int n) {
+  double* cdf = (double*)malloc((size_t)n * sizeof(double));
+  if (cdf == NULL) {
+    fprintf(stderr, "Memory allocation failed for the Zipf table\n");
+    exit(1);
+  }
+  double total = 0;
+  for (int i = 0; i < n; i++) {
+    total += 1.0 / pow((double)(i + 1), ZIPF_EXPONENT);
+    cdf[i] = total;
+  }
+  for (int s = 0; s < count; s++) {
+    double u = (double)(nextRandom() >> 11) / 9007199254740992.0 * total;
+    int lo = 0;
+    int hi = n - 1;
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < u) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    samples[s] = lo;
+  }
+  free(cdf);
+}
+
+BenchResult benchSequentialInsert(int n) {
+  double start = now();
+  RAVL_Node* root = NULL;
+  for (int i = 0; i < n; i++) {
+    root = insert(root, i, NULL);
+  }
+  BenchResult result = {"seq_insert", n, now() - start,
+                        (unsigned long)root->height};
+  deleteTree(root);
+  return result;
+}
+
+BenchResult benchFingerAppend(int n) {
+  double start = now();
+  RAVL_Finger finger;
+  fingerInit(&finger, NULL, NULL);
+  for (int i = 0; i < n; i++) {
+    fingerInsert(&finger, i, NULL);
+  }
+  BenchResult result = {"finger_append", n, now() - start,
+                        (unsigned long)finger.root->height};
+  deleteTree(finger.root);
+  return result;
+}
+
+BenchResult benchParallelBuild(int n) {
+  int* keys = (int*)malloc((size_t)n * sizeof(int));
+  if (keys == NULL) {
+    fprintf(stderr, "Memory allocation failed for the sorted keys\n");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++) {
+    keys[i] = i;
+  }
+  double start = now();
+  RAVL_Node* root = buildFromSortedParallel(keys, NULL, n, threads);
+  BenchResult result = {"parallel_build", n, now() - start,
+                        (unsigned long)root->height};
+  deleteTree(root);
+  free(keys);
+  return result;
+}
+
+BenchResult benchRandomInsert(int* keys, int n) {
+  double start = now();
+  RAVL_Node* root = NULL;
+  for (int i = 0; i < n; i++) {
+    root = insert(root, keys[i], NULL);
+  }
+  unsigned long height = (unsigned long)root->height;
+  deleteTree(root);
+  BenchResult result = {"rand_insert", n, now() - start, height};
+  return result;
+}
+
+BenchResult benchRandomInsertArena(int* keys, int n) {
+  double start = now();
+  RAVL_Tree* tree = newTree();
+  for (int i = 0; i < n; i++) {
+    treeInsert(tree, keys[i], NULL);
+  }
+  freeTree(tree);
+  BenchResult result = {"rand_insert_arena", n, now() - start, 0};
+  return result;
+}
+
+/* Same as rand_insert, but through the int64_t specialization of
+ * RAVL_tree_generic.h, with each key widened beyond the range of int.
+ */
+BenchResult benchRandomInsertInt64(int* keys, int n) {
+  double start = now();
+  RAVL64_Node* root = NULL;
+  for (int i = 0; i < n; i++) {
+    root = RAVL64_insert(root, (int64_t)keys[i] << 32, NULL);
+  }
+  unsigned long height = (unsigned long)root->height;
+  RAVL64_deleteTree(root);
+  BenchResult result = {"rand_insert_int64", n, now() - start, height};
+  return result;
+}
+
+/* Same as rand_insert, but with 16-byte keys compared by memcmp, each
+ * holding its int key big-endian after a 12-byte common prefix.
+ */
+BenchResult benchRandomInsertKey16(int* keys, int n) {
+  double start = now();
+  RAVL16_Node* root = NULL;
+  for (int i = 0; i < n; i++) {
+    RAVL_Key16 key;
+    memset(key.bytes, 'k', 12);
+    for (int b = 0; b < 4; b++) {
+      key.bytes[12 + b] = (unsigned char)((uint32_t)keys[i] >> (24 - 8 * b));
+    }
+    root = RAVL16_insert(root, key, NULL);
+  }
+  unsigned long height = (unsigned long)root->height;
+  RAVL16_deleteTree(root);
+  BenchResult result = {"rand_insert_key16", n, now() - start, height};
+  return result;
+}
+
+/* Searches for keys[samples[i]], so the popular ranks map to keys spread
+ * over the whole tree rather than to its smallest keys.
+ */
+BenchResult benchZipfSearch(RAVL_Node* root, int* keys, int* samples,
+                            int count) {
+  unsigned long checksum = 0;
+  double start = now();
+  for (int i = 0; i < count; i++) {
+    RAVL_Node* node = search(root, keys[samples[i]]);
+    checksum += (unsigned long)node->height;
+  }
+  BenchResult result = {"zipf_search", count, now() - start, checksum};
+  return result;
+}
+
+/* 90% searches, 10% updates split evenly between inserts and deletes, all
+ * on random keys from [0, 2n), so the tree size stays near n.
+ */
+BenchResult benchMixed(RAVL_Node** root, int n, int count) {
+  unsigned long checksum = 0;
+  double start = now();
+  for (int i = 0; i < count; i++) {
+    int dice = randomBelow(20);
+    int key = randomBelow(2 * n);
+    if (dice == 0) {
+      *root = insert(*root, key, NULL);
+    } else if (dice == 1) {
+      *root = delete(*root, key);
+    } else {
+      checksum += search(*root, key) != NULL;
+    }
+  }
+  BenchResult result = {"mixed_90_10", count, now() - start, checksum};
+  return result;
+}
+
+BenchResult benchRankSweep(RAVL_Node* root, int* keys, int n) {
+  unsigned long checksum = 0;
+  double start = now();
+  for (int i = 0; i < n; i++) {
+    checksum += (unsigned long)rank(root, keys[i]);
+  }
+  BenchResult result = {"rank_sweep", n, now() - start, checksum};
+  return result;
+}
+
+BenchResult benchRankBatch(RAVL_Node* root, int* keys, int n) {
+  int* ranks = (int*)malloc((size_t)n * sizeof(int));
+  if (ranks == NULL) {
+    fprintf(stderr, "Memory allocation failed for the ranks\n");
+    exit(1);
+  }
+  double start = now();
+  rankBatch(root, keys, ranks, n, threads);
+  double seconds = now() - start;
+  unsigned long checksum = 0;
+  for (int i = 0; i < n; i++) {
+    checksum += (unsigned long)ranks[i];
+  }
+  free(ranks);
+  BenchResult result = {"rank_batch", n, seconds, checksum};
+  return result;
+}
+
+BenchResult benchFindRankSweep(RAVL_Node* root, int n) {
+  unsigned long checksum = 0;
+  double start = now();
+  for (int r = 1; r <= n; r++) {
+    checksum += (unsigned long)findRank(root, r)->key;
+  }
+  BenchResult result = {"find_rank_sweep", n, now() - start, checksum};
+  return result;
+}
+
+/* Reads every key in rank order, RANGE_CHUNK at a time, with
+ * findRankRange; 'ops' counts keys, as in find_rank_sweep.
+ */
+BenchResult benchFindRankRange(RAVL_Node* root, int n) {
+  int keys[RANGE_CHUNK];
+  unsigned long checksum = 0;
+  double start = now();
+  for (int r = 1; r <= n; r += RANGE_CHUNK) {
+    int got = findRankRange(root, r, RANGE_CHUNK, keys, NULL);
+    for (int i = 0; i < got; i++) {
+      checksum += (unsigned long)keys[i];
+    }
+  }
+  BenchResult result = {"find_rank_range", n, now() - start, checksum};
+  return result;
+}
+
+BenchResult benchDeleteStorm(RAVL_Node** root, int* keys, int n) {
+  double start = now();
+  for (int i = 0; i < n; i++) {
+    *root = delete(*root, keys[i]);
+  }
+  BenchResult result = {"delete_storm", n, now() - start,
+                        (unsigned long)(*root == NULL)};
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  int n = DEFAULT_KEYS;
+  uint64_t seed = DEFAULT_SEED;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      n = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      jsonOutput = strcmp(argv[++i], "json") == 0;
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      setBalance(strcmp(argv[++i], "weight") == 0 ? RAVL_BALANCE_WEIGHT
+                                                  : RAVL_BALANCE_AVL);
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else {
+      fprintf(stderr,
+              "Usage: %s [-n keys] [-s seed] [-f csv|json] [-p avl|weight] "
+              "[-t threads]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (n <= 0) {
+    fprintf(stderr, "The number of keys must be positive.\n");
+    return 1;
+  }
+  rngState = seed;
+
+  int* keys = (int*)malloc((size_t)n * sizeof(int));
+  int* samples = (int*)malloc((size_t)n * sizeof(int));
+  if (keys == NULL || samples == NULL) {
+    fprintf(stderr, "Memory allocation failed for the workload\n");
+    return 1;
+  }
+  shuffledKeys(keys, n);
+  zipfSamples(samples, n, n);
+
+  if (!jsonOutput) {
+    printf("workload,ops,ns_per_op,ops_per_sec,peak_rss_kb,checksum\n");
+  }
+  report(benchSequentialInsert(n));
+  report(benchFingerAppend(n));
+  report(benchParallelBuild(n));
+  report(benchRandomInsert(keys, n));
+  report(benchRandomInsertArena(keys, n));
+  report(benchRandomInsertInt64(keys, n));
+  report(benchRandomInsertKey16(keys, n));
+
+  RAVL_Node* root = NULL;
+  for (int i = 0; i < n; i++) {
+    root = insert(root, keys[i], NULL);
+  }
+  report(benchZipfSearch(root, keys, samples, n));
+  report(benchRankSweep(root, keys, n));
+  report(benchRankBatch(root, keys, n));
+  report(benchFindRankSweep(root, n));
+  report(benchFindRankRange(root, n));
+  report(benchMixed(&root, n, n));
+  deleteTree(root);
+
+  root = NULL;
+  for (int i = 0; i < n; i++) {
+    root = insert(root, keys[i], NULL);
+  }
+  shuffledKeys(keys, n);
+  report(benchDeleteStorm(&root, keys, n));
+  deleteTree(root);
+
+  free(keys);
+  free(samples);
+  return 0;
+}
@@ -0,0 +1,1029 @@
+/*
+ *  Non-interactive checks of the RAVL tree extensions that the sample
+ *  session does not reach. Every check prints one line; the output is
+ *  deterministic, so a run can be compared against the expected output.
+ *
+ *  Compile:
+ *   gcc -g -Wall -Werror -pthread -DRAVL_AUGMENT RAVL_tree.c \
+ *       RAVL_tree_checks.c -o checks -lm
+ *
+ *  Run:
+ *   ./checks > checks_out.txt
+ *   diff checks_out.txt checks_output.txt
+ *
+ *  Don't forget:
+ *   valgrind --show-leak-kinds=all --leak-check=full ./checks
+ *   gcc -fsanitize=thread ... to check the concurrent readers
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RAVL_tree.h"
+#include "RAVL_tree_generic.h"
+
+#define READER_THREADS 4
+#define READER_ROUNDS 2000
+#define WRITER_OPS 20000
+#define STABLE_KEYS 100  // keys 0..STABLE_KEYS-1 are never deleted
+
+/* Returns the height of the tree rooted at 'node' if it is a valid AVL
+ * tree with keys in (lo, hi) and correct heights and sizes; returns -1
+ * otherwise.
+ */
+int checkAVL(RAVL_Node* node, long long lo, long long hi) {
+  if (node == NULL) {
+    return 0;
+  }
+  if (node->key <= lo || node->key >= hi || node->count < 1) {
+    return -1;
+  }
+  int lh = checkAVL(node->left, lo, node->key);
+  int rh = checkAVL(node->right, node->key, hi);
+  if (lh < 0 || rh < 0 || lh - rh > 1 || rh - lh > 1) {
+    return -1;
+  }
+  int ls = node->left == NULL ? 0 : node->left->size;
+  int rs = node->right == NULL ? 0 : node->right->size;
+  int height = (lh > rh ? lh : rh) + 1;
+  if (node->height != height || node->size != ls + rs + node->count) {
+    return -1;
+  }
+  return height;
+}
+
+/* Returns true iff the tree rooted at 'node' is a valid AVL tree. */
+bool isValidAVL(RAVL_Node* node) {
+  return checkAVL(node, (long long)INT_MIN - 1, (long long)INT_MAX + 1) >= 0;
+}
+
+/* Prints 'label' followed by the keys of the tree rooted at 'node' in
+ * order.
+ */
+void printKeys(const char* label, RAVL_Node* node) {
+  printf("%s:", label);
+  int n = node == NULL ? 0 : node->size;
+  for (int r = 1; r <= n; r++) {
+    printf(" %d", findRank(node, r)->key);
+  }
+  printf("\n");
+}
+
+/*************************************************************************
+ ** Versioned trees
+ *************************************************************************/
+
+typedef struct reader_job {
+  RAVL_Versioned* tree;  // tree to read
+  bool ok;               // false once any snapshot failed a check
+} ReaderJob;
+
+/* Takes READER_ROUNDS snapshots of the tree of '*arg' while the writer
+ * runs, and checks that each one is a valid AVL tree holding all of the
+ * stable keys.
+ */
+void* readerJob(void* arg) {
+  ReaderJob* job = (ReaderJob*)arg;
+  int reader = registerReader(job->tree);
+  if (reader == NOTIN) {
+    job->ok = false;
+    return NULL;
+  }
+  for (int i = 0; i < READER_ROUNDS; i++) {
+    RAVL_Node* root = readBegin(job->tree, reader);
+    if (!isValidAVL(root)) {
+      job->ok = false;
+    }
+    for (int key = 0; key < STABLE_KEYS; key += 7) {
+      if (search(root, key) == NULL) {
+        job->ok = false;
+      }
+    }
+    readEnd(job->tree, reader);
+  }
+  unregisterReader(job->tree, reader);
+  return NULL;
+}
+
+void checkVersioned(void) {
+  RAVL_Versioned* tree = newVersioned(NULL);
+  for (int key = 1; key <= 5; key++) {
+    versionedInsert(tree, key * 10, NULL);
+  }
+  printKeys("versioned v1", atomic_load(&tree->root));
+
+  // a snapshot keeps seeing its version while the writer moves on
+  int reader = registerReader(tree);
+  RAVL_Node* old = readBegin(tree, reader);
+  versionedInsert(tree, 25, NULL);
+  versionedDelete(tree, 40);
+  versionedDelete(tree, 99);  // absent: no new version
+  printKeys("snapshot after writes", old);
+  printKeys("latest after writes", atomic_load(&tree->root));
+  printf("retired while reading: %s\n", tree->numRetired > 0 ? "yes" : "no");
+  printf("snapshot valid: %s\n", isValidAVL(old) ? "yes" : "no");
+  readEnd(tree, reader);
+  unregisterReader(tree, reader);
+
+  // with no reader left, the next write reclaims every old version
+  versionedInsert(tree, 60, NULL);
+  printf("retired after readEnd and a write: %d\n", tree->numRetired);
+  printKeys("latest", atomic_load(&tree->root));
+  deleteVersioned(tree);
+
+  // one writer churning against concurrent readers
+  tree = newVersioned(NULL);
+  for (int key = 0; key < STABLE_KEYS; key++) {
+    versionedInsert(tree, key, NULL);
+  }
+  ReaderJob jobs[READER_THREADS];
+  pthread_t threads[READER_THREADS];
+  for (int i = 0; i < READER_THREADS; i++) {
+    jobs[i].tree = tree;
+    jobs[i].ok = true;
+    pthread_create(&threads[i], NULL, readerJob, &jobs[i]);
+  }
+  unsigned int seed = 17;
+  for (int i = 0; i < WRITER_OPS; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = STABLE_KEYS + (int)(seed >> 16) % 1000;
+    if (i % 3 == 2) {
+      versionedDelete(tree, key);
+    } else {
+      versionedInsert(tree, key, NULL);
+    }
+  }
+  bool ok = true;
+  for (int i = 0; i < READER_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    ok = ok && jobs[i].ok;
+  }
+  printf("concurrent readers saw valid snapshots: %s\n", ok ? "yes" : "no");
+  printf("final version valid: %s\n",
+         isValidAVL(atomic_load(&tree->root)) ? "yes" : "no");
+  deleteVersioned(tree);
+}
+
+/*************************************************************************
+ ** Finger search
+ *************************************************************************/
+
+/* Returns true iff the trees rooted at 'a' and 'b' hold the same keys with
+ * the same values.
+ */
+bool sameContents(RAVL_Node* a, RAVL_Node* b) {
+  int n = a == NULL ? 0 : a->size;
+  if (n != (b == NULL ? 0 : b->size)) {
+    return false;
+  }
+  for (int r = 1; r <= n; r++) {
+    RAVL_Node* x = findRank(a, r);
+    RAVL_Node* y = findRank(b, r);
+    if (x->key != y->key || x->value != y->value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Inserts the same 'n' keys from 'keys' through a finger and with plain
+ * insert, and prints whether the two trees agree.
+ */
+void compareFingerInsert(const char* label, int* keys, int n) {
+  RAVL_Finger finger;
+  fingerInit(&finger, NULL, NULL);
+  RAVL_Node* plain = NULL;
+  for (int i = 0; i < n; i++) {
+    void* value = (void*)(intptr_t)(i + 1);
+    fingerInsert(&finger, keys[i], value);
+    plain = insert(plain, keys[i], value);
+  }
+  bool found = true;
+  for (int i = 0; i < n; i++) {
+    // each key, then one that may or may not be there
+    for (int key = keys[i]; key <= keys[i] + n; key += n) {
+      if (fingerSearch(&finger, key) != search(finger.root, key)) {
+        found = false;
+      }
+    }
+  }
+  printf("%s: %d keys, valid %s, same as insert %s, searches agree %s\n",
+         label, finger.root == NULL ? 0 : finger.root->size,
+         isValidAVL(finger.root) ? "yes" : "no",
+         sameContents(finger.root, plain) ? "yes" : "no",
+         found ? "yes" : "no");
+  deleteTree(finger.root);
+  deleteTree(plain);
+}
+
+void checkFinger(void) {
+  int n = 5000;
+  int* keys = (int*)malloc(2 * (size_t)n * sizeof(int));
+  if (keys == NULL) {
+    fprintf(stderr, "Memory allocation failed for the keys\n");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++) {
+    keys[i] = i;
+  }
+  compareFingerInsert("finger appends", keys, n);
+
+  for (int i = 0; i < n; i++) {
+    keys[i] = n - i;
+  }
+  compareFingerInsert("finger descending", keys, n);
+
+  // random keys with repeats, so the finger is re-seeked after rotations
+  // and existing keys get new values
+  unsigned int seed = 29;
+  for (int i = 0; i < 2 * n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    keys[i] = (int)(seed >> 16) % n;
+  }
+  compareFingerInsert("finger random", keys, 2 * n);
+
+  // runs of nearby keys, each run starting somewhere new
+  for (int i = 0; i < 2 * n; i++) {
+    if (i % 50 == 0) {
+      seed = seed * 1103515245u + 12345u;
+    }
+    keys[i] = (int)(seed >> 16) % (4 * n) + i % 50;
+  }
+  compareFingerInsert("finger runs", keys, 2 * n);
+  free(keys);
+}
+
+/*************************************************************************
+ ** Batch updates
+ *************************************************************************/
+
+/* Fills keys[0..n) with pseudo-random keys in [0, range), repeats included,
+ * and returns the next seed.
+ */
+unsigned int randomKeys(int* keys, int n, int range, unsigned int seed) {
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    keys[i] = (int)(seed >> 16) % range;
+  }
+  return seed;
+}
+
+/* Applies rounds of insertBatch and deleteBatch to one tree and the same
+ * keys one at a time to another, and prints whether the two agree.
+ */
+void checkBatches(void) {
+  int n = 3000;
+  int* keys = (int*)malloc((size_t)n * sizeof(int));
+  void** values = (void**)malloc((size_t)n * sizeof(void*));
+  if (keys == NULL || values == NULL) {
+    fprintf(stderr, "Memory allocation failed for the batches\n");
+    exit(1);
+  }
+  RAVL_Node* batched = NULL;
+  RAVL_Node* plain = NULL;
+  bool valid = true;
+  bool same = true;
+  unsigned int seed = 41;
+  for (int round = 0; round < 10; round++) {
+    // repeated keys in a batch: the last value given wins, as with insert
+    seed = randomKeys(keys, n, 4 * n, seed);
+    for (int i = 0; i < n; i++) {
+      values[i] = (void*)(intptr_t)(round * n + i + 1);
+    }
+    batched = insertBatch(batched, keys, values, n);
+    for (int i = 0; i < n; i++) {
+      plain = insert(plain, keys[i], values[i]);
+    }
+    valid = valid && isValidAVL(batched);
+    same = same && sameContents(batched, plain);
+
+    // about half of these are absent and must be ignored
+    seed = randomKeys(keys, n / 2, 8 * n, seed);
+    batched = deleteBatch(batched, keys, n / 2);
+    for (int i = 0; i < n / 2; i++) {
+      plain = delete(plain, keys[i]);
+    }
+    valid = valid && isValidAVL(batched);
+    same = same && sameContents(batched, plain);
+  }
+  printf("batch updates: %d keys, valid %s, same as one at a time %s\n",
+         batched == NULL ? 0 : batched->size, valid ? "yes" : "no",
+         same ? "yes" : "no");
+  batched = insertBatch(batched, keys, NULL, 0);
+  batched = deleteBatch(batched, NULL, 0);
+  printf("empty batches: tree unchanged %s\n",
+         sameContents(batched, plain) ? "yes" : "no");
+  deleteTree(batched);
+  deleteTree(plain);
+  free(keys);
+  free(values);
+}
+
+/*************************************************************************
+ ** Split and join
+ *************************************************************************/
+
+/* Returns the root of a tree holding the 'n' keys first, first + 2, ...,
+ * each with its key plus one as value.
+ */
+RAVL_Node* evenTree(int first, int n) {
+  RAVL_Node* node = NULL;
+  for (int i = 0; i < n; i++) {
+    int key = first + 2 * i;
+    node = insert(node, key, (void*)(intptr_t)(key + 1));
+  }
+  return node;
+}
+
+/* Joins 'left', a new node with key 'key' and 'right', and prints whether
+ * the result is a valid tree of the right size.
+ */
+void checkJoin(const char* label, RAVL_Node* left, int key, RAVL_Node* right) {
+  int n = (left == NULL ? 0 : left->size) + (right == NULL ? 0 : right->size);
+  RAVL_Node* joined = join(left, insert(NULL, key, NULL), right);
+  printf("%s: valid %s, size %s\n", label, isValidAVL(joined) ? "yes" : "no",
+         joined->size == n + 1 ? "right" : "wrong");
+  deleteTree(joined);
+}
+
+/* Splits trees of even keys at every key, present or not, and at every
+ * rank, and prints whether the halves were valid and held the right keys,
+ * and whether joining them restored the original tree.
+ */
+void checkSplitJoin(void) {
+  int n = 200;
+  RAVL_Node* reference = evenTree(0, n);
+  long long lo = (long long)INT_MIN - 1;
+  long long hi = (long long)INT_MAX + 1;
+  bool halves = true;
+  bool restored = true;
+  for (int key = -1; key <= 2 * n; key++) {
+    RAVL_Node* left;
+    RAVL_Node* right;
+    RAVL_Node* pivot = split(evenTree(0, n), key, &left, &right);
+    bool present = key >= 0 && key < 2 * n && key % 2 == 0;
+    halves = halves && checkAVL(left, lo, key) >= 0 &&
+             checkAVL(right, key, hi) >= 0 && (pivot != NULL) == present &&
+             (left == NULL ? 0 : left->size) == (key + 1) / 2;
+    RAVL_Node* joined =
+        join(left, present ? pivot : insert(NULL, key, NULL), right);
+    restored = restored && isValidAVL(joined);
+    if (!present) {
+      joined = delete(joined, key);
+    }
+    restored = restored && sameContents(joined, reference);
+    deleteTree(joined);
+  }
+  printf("split at every key: halves valid %s, join restores tree %s\n",
+         halves ? "yes" : "no", restored ? "yes" : "no");
+
+  halves = true;
+  restored = true;
+  for (int r = 0; r <= n + 1; r++) {
+    RAVL_Node* left;
+    RAVL_Node* right;
+    splitAtRank(evenTree(0, n), r, &left, &right);
+    int expected = r > n ? n : r;
+    halves = halves && isValidAVL(left) && isValidAVL(right) &&
+             (left == NULL ? 0 : left->size) == expected &&
+             (left == NULL ||
+              findRank(left, expected)->key == 2 * expected - 2);
+    if (right != NULL) {
+      // the smallest key on the right is the pivot to join on
+      RAVL_Node* empty;
+      RAVL_Node* pivot = split(right, findRank(right, 1)->key, &empty, &right);
+      left = join(left, pivot, right);
+    }
+    restored = restored && isValidAVL(left) && sameContents(left, reference);
+    deleteTree(left);
+  }
+  printf("split at every rank: halves valid %s, join restores tree %s\n",
+         halves ? "yes" : "no", restored ? "yes" : "no");
+  deleteTree(reference);
+
+  checkJoin("join small to tall", evenTree(0, 3), 100, evenTree(1000, 5000));
+  checkJoin("join tall to small", evenTree(0, 5000), 20000,
+            evenTree(30000, 3));
+  checkJoin("join with empty sides", NULL, 5, NULL);
+}
+
+/*************************************************************************
+ ** Generic keys
+ *************************************************************************/
+
+/* Defines prefix_checkShape, which returns the height of the tree rooted
+ * at 'node' if it has AVL balance and correct heights and sizes, and -1
+ * otherwise. Key order is checked through ranks instead.
+ */
+#define DEFINE_CHECK_SHAPE(prefix)                                           \
+  int prefix##_checkShape(prefix##_Node* node) {                             \
+    if (node == NULL) {                                                      \
+      return 0;                                                              \
+    }                                                                        \
+    int lh = prefix##_checkShape(node->left);                                \
+    int rh = prefix##_checkShape(node->right);                               \
+    if (lh < 0 || rh < 0 || lh - rh > 1 || rh - lh > 1) {                    \
+      return -1;                                                             \
+    }                                                                        \
+    int height = (lh > rh ? lh : rh) + 1;                                    \
+    int size = prefix##_size(node->left) + prefix##_size(node->right) + 1;   \
+    return node->height == height && node->size == size ? height : -1;       \
+  }
+
+DEFINE_CHECK_SHAPE(RAVL64)
+DEFINE_CHECK_SHAPE(RAVL16)
+
+/* Returns 'key' as an int64_t outside the range of int, in the same order. */
+int64_t wideKey(int key) { return (int64_t)key * 4294967296LL + 12345; }
+
+/* Returns 'key' as a 16-byte key whose memcmp order is the order of int. */
+RAVL_Key16 bytesKey(int key) {
+  RAVL_Key16 k;
+  memset(k.bytes, 0xA5, sizeof(k.bytes));
+  uint32_t biased = (uint32_t)key ^ 0x80000000u;  // sign bit flipped
+  for (int i = 0; i < 4; i++) {
+    k.bytes[i] = (unsigned char)(biased >> (24 - 8 * i));
+  }
+  return k;
+}
+
+/* Applies the same random inserts and deletes to an int tree and to the
+ * int64_t and 16-byte specializations of RAVL_tree_generic.h, with keys
+ * mapped in order, and prints whether the generic trees stayed balanced
+ * and agreed with the int tree on every search, rank and findRank.
+ */
+void checkGeneric(void) {
+  RAVL_Node* plain = NULL;
+  RAVL64_Node* wide = NULL;
+  RAVL16_Node* bytes = NULL;
+  bool agree = true;
+  unsigned int seed = 53;
+  for (int i = 0; i < 20000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = (int)(seed >> 16) % 3000 - 1500;
+    void* value = (void*)(intptr_t)(i + 1);
+    if (i % 3 == 2) {
+      plain = delete(plain, key);
+      wide = RAVL64_delete(wide, wideKey(key));
+      bytes = RAVL16_delete(bytes, bytesKey(key));
+    } else {
+      plain = insert(plain, key, value);
+      wide = RAVL64_insert(wide, wideKey(key), value);
+      bytes = RAVL16_insert(bytes, bytesKey(key), value);
+    }
+    RAVL_Node* node = search(plain, key);
+    RAVL64_Node* wideNode = RAVL64_search(wide, wideKey(key));
+    RAVL16_Node* bytesNode = RAVL16_search(bytes, bytesKey(key));
+    agree = agree && (wideNode == NULL ? NULL : wideNode->value) ==
+                         (node == NULL ? NULL : node->value) &&
+            (bytesNode == NULL ? NULL : bytesNode->value) ==
+                (node == NULL ? NULL : node->value);
+  }
+  int n = plain == NULL ? 0 : plain->size;
+  for (int r = 1; r <= n; r++) {
+    int key = findRank(plain, r)->key;
+    agree = agree && RAVL64_rank(wide, wideKey(key)) == r &&
+            RAVL16_rank(bytes, bytesKey(key)) == r &&
+            RAVL64_findRank(wide, r)->key == wideKey(key) &&
+            memcmp(RAVL16_findRank(bytes, r)->key.bytes,
+                   bytesKey(key).bytes, 16) == 0;
+  }
+  agree = agree && RAVL64_rank(wide, wideKey(1500)) == NOTIN &&
+          RAVL16_findRank(bytes, n + 1) == NULL;
+  printf("generic keys: %d keys, int64 valid %s, 16-byte valid %s, "
+         "agree with int tree %s\n",
+         n, RAVL64_checkShape(wide) >= 0 ? "yes" : "no",
+         RAVL16_checkShape(bytes) >= 0 ? "yes" : "no", agree ? "yes" : "no");
+  deleteTree(plain);
+  RAVL64_deleteTree(wide);
+  RAVL16_deleteTree(bytes);
+}
+
+/*************************************************************************
+ ** Augmentations
+ *************************************************************************/
+
+#ifdef RAVL_AUGMENT
+#define HASH_MODULUS 2147483629LL  // prime below 2^31
+#define HASH_BASE 1000003LL
+
+/* An order-sensitive hash of a key sequence, packed as (h << 31) | p: h is
+ * the polynomial hash of the keys and p is HASH_BASE to the power of their
+ * number, both modulo HASH_MODULUS. Combining in the wrong order changes
+ * the hash, so it catches aggregates folded right to left.
+ */
+long long measureHash(RAVL_Node* node) {
+  return ((((long long)node->key % HASH_MODULUS + HASH_MODULUS) % HASH_MODULUS)
+          << 31) | HASH_BASE;
+}
+
+long long combineHash(long long a, long long b) {
+  long long ha = a >> 31;
+  long long pa = a & 0x7FFFFFFF;
+  long long hb = b >> 31;
+  long long pb = b & 0x7FFFFFFF;
+  long long h = (ha * pb % HASH_MODULUS + hb) % HASH_MODULUS;
+  return (h << 31) | (pa * pb % HASH_MODULUS);
+}
+
+const RAVL_Augment hashAugment = {1, measureHash, combineHash};
+
+/* Returns the hash of the keys k of the tree rooted at 'node' with
+ * lo <= k <= hi, folded left to right one node at a time.
+ */
+long long referenceHash(RAVL_Node* node, int lo, int hi) {
+  long long acc = hashAugment.identity;
+  RAVL_Cursor cursor;
+  for (cursorSeek(&cursor, node, lo);
+       !cursorAtEnd(&cursor) && cursorNode(&cursor)->key <= hi;
+       cursorNext(&cursor)) {
+    acc = combineHash(acc, measureHash(cursorNode(&cursor)));
+  }
+  return acc;
+}
+
+/* Keeps the order-sensitive hash as the augmentation of a tree under
+ * random inserts and deletes, and prints whether rangeAggregate and
+ * prefixAggregate match a left-to-right fold over random ranges.
+ */
+void checkAugment(void) {
+  setAugment(&hashAugment);
+  RAVL_Node* node = NULL;
+  unsigned int seed = 61;
+  for (int i = 0; i < 6000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = (int)(seed >> 16) % 4000 - 2000;
+    node = i % 4 == 3 ? delete(node, key) : insert(node, key, NULL);
+  }
+  bool ranges = true;
+  bool prefixes = true;
+  for (int i = 0; i < 2000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int lo = (int)(seed >> 16) % 4400 - 2200;
+    seed = seed * 1103515245u + 12345u;
+    int hi = lo + (int)(seed >> 16) % 600;
+    ranges = ranges && rangeAggregate(node, lo, hi) ==
+                           referenceHash(node, lo, hi);
+    prefixes = prefixes && prefixAggregate(node, hi) ==
+                               referenceHash(node, INT_MIN, hi);
+  }
+  printf("ordered aggregates: range matches fold %s, prefix matches fold "
+         "%s\n", ranges ? "yes" : "no", prefixes ? "yes" : "no");
+  deleteTree(node);
+}
+#else
+void checkAugment(void) {
+  printf("ordered aggregates: not compiled in; build with -DRAVL_AUGMENT\n");
+}
+#endif
+
+/*************************************************************************
+ ** Snapshot files
+ *************************************************************************/
+
+#define SNAPSHOT_PATH "checks_snapshot.ravl"
+
+/* Reads the file 'path' into 'buffer', which has room for 'capacity'
+ * bytes, and returns its length, or -1 if it could not be read.
+ */
+long readFile(const char* path, char* buffer, long capacity) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+  long length = (long)fread(buffer, 1, (size_t)capacity, file);
+  fclose(file);
+  return length;
+}
+
+/* Replaces the file 'path' with the 'length' bytes of 'buffer'. */
+void writeFile(const char* path, const char* buffer, long length) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL || fwrite(buffer, 1, (size_t)length, file) !=
+                          (size_t)length) {
+    fprintf(stderr, "Could not write %s\n", path);
+    exit(1);
+  }
+  fclose(file);
+}
+
+/* Writes 'length' bytes of 'buffer', with 'bytes' bytes at 'offset'
+ * overwritten by 'patch', to SNAPSHOT_PATH, and prints whether loading and
+ * mapping it both fail.
+ */
+void checkBadSnapshot(const char* label, const char* buffer, long length,
+                      long offset, const void* patch, size_t bytes) {
+  char* copy = (char*)malloc((size_t)length);
+  if (copy == NULL) {
+    fprintf(stderr, "Memory allocation failed for a snapshot copy\n");
+    exit(1);
+  }
+  memcpy(copy, buffer, (size_t)length);
+  memcpy(copy + offset, patch, bytes);
+  writeFile(SNAPSHOT_PATH, copy, length);
+  free(copy);
+  RAVL_Node* node = NULL;
+  bool loaded = loadSnapshot(SNAPSHOT_PATH, &node);
+  RAVL_Snapshot* snapshot = mapSnapshot(SNAPSHOT_PATH);
+  printf("%s: load rejected %s, map rejected %s\n", label,
+         loaded ? "no" : "yes", snapshot == NULL ? "yes" : "no");
+  deleteTree(node);
+  unmapSnapshot(snapshot);
+}
+
+/* Saves trees to SNAPSHOT_PATH and prints whether loading and mapping them
+ * gives back the same keys and values, then corrupts the file in several
+ * ways and prints whether each is rejected.
+ */
+void checkSnapshots(void) {
+  RAVL_Node* node = NULL;
+  bool saved = saveSnapshot(node, SNAPSHOT_PATH);
+  RAVL_Node* loaded = NULL;
+  bool ok = saved && loadSnapshot(SNAPSHOT_PATH, &loaded) && loaded == NULL;
+  printf("empty snapshot: round trip %s\n", ok ? "yes" : "no");
+
+  int n = 5000;
+  unsigned int seed = 67;
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = (int)(seed >> 1) - (INT_MAX / 2);  // negative ones included
+    node = insert(node, key, (void*)(intptr_t)(seed % 100000));
+  }
+  n = node->size;
+  saved = saveSnapshot(node, SNAPSHOT_PATH);
+  ok = saved && loadSnapshot(SNAPSHOT_PATH, &loaded);
+  printf("snapshot of %d keys: saved %s, loaded valid %s, same contents %s\n",
+         n, saved ? "yes" : "no", ok && isValidAVL(loaded) ? "yes" : "no",
+         ok && sameContents(node, loaded) ? "yes" : "no");
+  deleteTree(loaded);
+
+  RAVL_Snapshot* snapshot = mapSnapshot(SNAPSHOT_PATH);
+  bool mapped = snapshot != NULL && snapshot->size == n;
+  for (int r = 1; mapped && r <= n; r++) {
+    RAVL_Node* expected = findRank(node, r);
+    mapped = snapshotKey(snapshot, r) == expected->key &&
+             snapshotValue(snapshot, r) == expected->value &&
+             snapshotRank(snapshot, expected->key) == r;
+  }
+  mapped = mapped && snapshotRank(snapshot, INT_MAX) == NOTIN;
+  printf("mapped snapshot: keys, values and ranks match %s\n",
+         mapped ? "yes" : "no");
+  unmapSnapshot(snapshot);
+
+  // header, keys, alignment and values, with room to spare
+  long capacity = (long)sizeof(RAVL_SnapshotHeader) + 16 * (long)n + 64;
+  char* buffer = (char*)malloc((size_t)capacity);
+  if (buffer == NULL) {
+    fprintf(stderr, "Memory allocation failed for the snapshot file\n");
+    exit(1);
+  }
+  long length = readFile(SNAPSHOT_PATH, buffer, capacity);
+  uint32_t badVersion = RAVL_SNAPSHOT_VERSION + 1;
+  uint64_t badCount = (uint64_t)n + 1;
+  checkBadSnapshot("bad magic", buffer, length, 0, "RAVX", 4);
+  checkBadSnapshot("bad version", buffer, length, 4, &badVersion,
+                   sizeof(badVersion));
+  checkBadSnapshot("count past the end", buffer, length, 8, &badCount,
+                   sizeof(badCount));
+  checkBadSnapshot("truncated", buffer, length - 8, 0, "", 0);
+  checkBadSnapshot("cut inside the header", buffer, 10, 0, "", 0);
+
+  // swap two keys: the header still checks out, so only loading notices
+  int32_t swapped[2];
+  memcpy(swapped, buffer + sizeof(RAVL_SnapshotHeader) + sizeof(int32_t),
+         sizeof(int32_t));
+  memcpy(swapped + 1, buffer + sizeof(RAVL_SnapshotHeader), sizeof(int32_t));
+  checkBadSnapshot("keys out of order", buffer, length,
+                   (long)sizeof(RAVL_SnapshotHeader), swapped,
+                   sizeof(swapped));
+  free(buffer);
+  remove(SNAPSHOT_PATH);
+  printf("missing file: load rejected %s\n",
+         loadSnapshot(SNAPSHOT_PATH, &loaded) ? "no" : "yes");
+  deleteTree(node);
+}
+
+/*************************************************************************
+ ** Multisets
+ *************************************************************************/
+
+#define MULTISET_KEYS 400
+
+/* Returns true iff the tree rooted at 'node' is a valid AVL tree whose
+ * counts are 'counts' and whose ranks follow from them.
+ */
+bool matchesCounts(RAVL_Node* node, int* counts) {
+  if (!isValidAVL(node)) {
+    return false;
+  }
+  int below = 0;
+  for (int key = 0; key < MULTISET_KEYS; key++) {
+    RAVL_Node* found = search(node, key);
+    if ((found == NULL ? 0 : found->count) != counts[key]) {
+      return false;
+    }
+    if (counts[key] > 0 &&
+        (rank(node, key) != below + 1 ||
+         findRank(node, below + counts[key]) != found)) {
+      return false;
+    }
+    below += counts[key];
+  }
+  return (node == NULL ? 0 : node->size) == below;
+}
+
+/* Returns true iff deleting 'key' from the tree rooted at 'node' replaces
+ * its node by a successor that holds a different number of copies.
+ */
+bool successorCountDiffers(RAVL_Node* node, int key) {
+  node = search(node, key);
+  if (node == NULL || node->left == NULL || node->right == NULL) {
+    return false;
+  }
+  RAVL_Node* suc = node->right;
+  while (suc->left != NULL) {
+    suc = suc->left;
+  }
+  return suc->count != node->count;
+}
+
+/* Churns a multiset with insertCopy, deleteCopy and delete, and prints how
+ * often delete went through a successor with a different count, and
+ * whether sizes, counts and ranks stayed right throughout.
+ */
+void checkMultiset(void) {
+  int counts[MULTISET_KEYS] = {0};
+  RAVL_Node* node = NULL;
+  int differing = 0;
+  bool ok = true;
+  unsigned int seed = 71;
+  for (int i = 0; i < 20000 && ok; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = (int)(seed >> 16) % MULTISET_KEYS;
+    int kind = (int)(seed >> 8) % 8;
+    if (kind < 5) {
+      node = insertCopy(node, key, NULL);
+      counts[key]++;
+    } else if (kind < 7) {
+      node = deleteCopy(node, key);
+      counts[key] -= counts[key] > 0;
+    } else {
+      differing += successorCountDiffers(node, key);
+      node = delete(node, key);
+      counts[key] = 0;
+    }
+    ok = matchesCounts(node, counts);
+  }
+  printf("multiset churn: %d deletes through a successor with another "
+         "count, sizes and ranks right %s\n",
+         differing, ok ? "yes" : "no");
+  deleteTree(node);
+}
+
+/*************************************************************************
+ ** Weight balance
+ *************************************************************************/
+
+#define WEIGHT_KEYS 3000
+
+/* Returns the height of the tree rooted at 'node' if it is a search tree
+ * with keys in (lo, hi), correct heights and sizes, and sibling weights
+ * (size plus one) within a factor of three; returns -1 otherwise.
+ */
+int checkWeight(RAVL_Node* node, long long lo, long long hi) {
+  if (node == NULL) {
+    return 0;
+  }
+  if (node->key <= lo || node->key >= hi || node->count != 1) {
+    return -1;
+  }
+  int lh = checkWeight(node->left, lo, node->key);
+  int rh = checkWeight(node->right, node->key, hi);
+  long long lw = (node->left == NULL ? 0 : node->left->size) + 1LL;
+  long long rw = (node->right == NULL ? 0 : node->right->size) + 1LL;
+  if (lh < 0 || rh < 0 || lw > 3 * rw || rw > 3 * lw) {
+    return -1;
+  }
+  int height = (lh > rh ? lh : rh) + 1;
+  if (node->height != height || node->size != lw + rw - 1) {
+    return -1;
+  }
+  return height;
+}
+
+/* Returns true iff the tree rooted at 'node' is weight-balanced and no
+ * taller than the bound in RAVL_tree.h.
+ */
+bool isValidWeight(RAVL_Node* node) {
+  int height = checkWeight(node, (long long)INT_MIN - 1,
+                           (long long)INT_MAX + 1);
+  int n = node == NULL ? 0 : node->size;
+  return height >= 0 && height <= log(n + 1) / log(4.0 / 3.0) + 1;
+}
+
+/* Returns true iff the tree rooted at 'node' holds exactly the keys marked
+ * in 'present', with the ranks that follow from them.
+ */
+bool holdsKeys(RAVL_Node* node, bool* present) {
+  int r = 0;
+  for (int key = 0; key < WEIGHT_KEYS; key++) {
+    if (present[key]) {
+      r++;
+      if (rank(node, key) != r) {
+        return false;
+      }
+    } else if (search(node, key) != NULL) {
+      return false;
+    }
+  }
+  return r == (node == NULL ? 0 : node->size);
+}
+
+/* Builds trees under weight balance, by appends and by random inserts and
+ * deletes, and prints whether the weight invariant held after every update
+ * and the trees held the right keys.
+ */
+void checkWeightBalance(void) {
+  setBalance(RAVL_BALANCE_WEIGHT);
+  bool present[WEIGHT_KEYS] = {false};
+  RAVL_Node* node = NULL;
+  bool ok = true;
+  for (int key = 0; key < WEIGHT_KEYS && ok; key++) {
+    node = insert(node, key, NULL);
+    present[key] = true;
+    ok = isValidWeight(node);
+  }
+  ok = ok && holdsKeys(node, present);
+  printf("weight-balanced appends: %d keys, height %d, invariant held %s\n",
+         node->size, node->height, ok ? "yes" : "no");
+
+  unsigned int seed = 73;
+  for (int i = 0; i < 20000 && ok; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = (int)(seed >> 16) % WEIGHT_KEYS;
+    if (i % 2 == 1) {
+      node = delete(node, key);
+      present[key] = false;
+    } else {
+      node = insert(node, key, NULL);
+      present[key] = true;
+    }
+    // the shape after every update, the keys now and then
+    ok = isValidWeight(node) && (i % 100 != 0 || holdsKeys(node, present));
+  }
+  ok = ok && holdsKeys(node, present);
+  printf("weight-balanced churn: %d keys, invariant held %s\n",
+         node == NULL ? 0 : node->size, ok ? "yes" : "no");
+  deleteTree(node);
+  setBalance(RAVL_BALANCE_AVL);
+}
+
+/*************************************************************************
+ ** Compact layout, cursors and findRankRange
+ *************************************************************************/
+
+/* Returns true iff findRankRange, in chunks of 'k' keys starting at every
+ * rank, copies out what findRank finds rank by rank, counting copies.
+ */
+bool rangesMatchFindRank(RAVL_Node* node, int k) {
+  int n = node == NULL ? 0 : node->size;
+  int* keys = (int*)malloc((size_t)k * sizeof(int));
+  void** values = (void**)malloc((size_t)k * sizeof(void*));
+  if (keys == NULL || values == NULL) {
+    fprintf(stderr, "Memory allocation failed for a rank range\n");
+    exit(1);
+  }
+  bool ok = true;
+  for (int start = 1; start <= n + 1 && ok; start += 1 + start / 4) {
+    int got = findRankRange(node, start, k, keys, values);
+    int expected = n - start + 1 < k ? n - start + 1 : k;
+    ok = got == expected;
+    for (int i = 0; i < got && ok; i++) {
+      RAVL_Node* found = findRank(node, start + i);
+      ok = keys[i] == found->key && values[i] == found->value;
+    }
+  }
+  free(keys);
+  free(values);
+  return ok;
+}
+
+/* Returns true iff 'compact' has the same keys, values, ranks and subtree
+ * heights as the tree rooted at 'node'.
+ */
+bool compactMatches(RAVL_Compact* compact, RAVL_Node* node) {
+  int n = node == NULL ? 0 : node->size;
+  if (compact->size != n || compactFindRank(compact, n + 1) != NULL) {
+    return false;
+  }
+  for (int r = 1; r <= n; r++) {
+    RAVL_Node* expected = findRank(node, r);
+    RAVL_CompactNode* found = compactFindRank(compact, r);
+    if (found == NULL || found->key != expected->key ||
+        compactValue(compact, found) != expected->value ||
+        compactSearch(compact, expected->key) != found ||
+        compactRank(compact, expected->key) != r ||
+        compactHeight(compact, found) != expected->height) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Returns true iff cursors walk the tree rooted at 'node' in rank order in
+ * both directions, and cursorSeek lands on the smallest key >= each of
+ * 'probes' probe keys drawn from [lo, hi).
+ */
+bool cursorsMatch(RAVL_Node* node, int lo, int hi, int probes) {
+  int n = node == NULL ? 0 : node->size;
+  RAVL_Cursor cursor;
+  int r = 1;
+  for (cursorSeekRank(&cursor, node, 1); !cursorAtEnd(&cursor);
+       cursorNext(&cursor)) {
+    if (cursorNode(&cursor) != findRank(node, r++)) {
+      return false;
+    }
+  }
+  if (r != n + 1) {
+    return false;
+  }
+  for (cursorSeekRank(&cursor, node, n); !cursorAtEnd(&cursor);
+       cursorPrev(&cursor)) {
+    if (cursorNode(&cursor) != findRank(node, --r)) {
+      return false;
+    }
+  }
+  if (r != 1) {
+    return false;
+  }
+  for (int i = 0; i < probes; i++) {
+    int key = lo + (int)((long long)(hi - lo) * i / probes);
+    cursorSeek(&cursor, node, key);
+    RAVL_Node* expected = findRank(node, rankLowerBound(node, key));
+    if (cursorNode(&cursor) != expected) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Reads the same trees through the compact layout, cursors and
+ * findRankRange, and prints whether each agrees with findRank.
+ */
+void checkReaders(void) {
+  RAVL_Node* node = NULL;
+  unsigned int seed = 79;
+  for (int i = 0; i < 6000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int key = (int)(seed >> 16) % 10000 - 5000;
+    node = i % 3 == 2 ? delete(node, key)
+                      : insert(node, key, (void*)(intptr_t)(i + 1));
+  }
+  RAVL_Compact* compact = compactFromTree(node);
+  RAVL_Compact* empty = compactFromTree(NULL);
+  printf("compact layout: %d keys, matches tree %s, empty matches %s\n",
+         compact->size, compactMatches(compact, node) ? "yes" : "no",
+         compactMatches(empty, NULL) ? "yes" : "no");
+  deleteCompact(compact);
+  deleteCompact(empty);
+  printf("cursors: walks and seeks match ranks %s, empty tree %s\n",
+         cursorsMatch(node, -5100, 5100, 2000) ? "yes" : "no",
+         cursorsMatch(NULL, 0, 10, 10) ? "yes" : "no");
+  printf("findRankRange: chunks of 1, 7 and 64 match findRank %s\n",
+         rangesMatchFindRank(node, 1) && rangesMatchFindRank(node, 7) &&
+                 rangesMatchFindRank(node, 64)
+             ? "yes"
+             : "no");
+  deleteTree(node);
+
+  // a multiset: every copy of a key has its own rank
+  node = NULL;
+  for (int i = 0; i < 3000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    node = insertCopy(node, (int)(seed >> 16) % 300, (void*)(intptr_t)i);
+  }
+  printf("findRankRange on a multiset: matches findRank %s\n",
+         rangesMatchFindRank(node, 5) && rangesMatchFindRank(node, 100)
+             ? "yes"
+             : "no");
+  deleteTree(node);
+}
+
+int main(void) {
+  checkVersioned();
+  checkFinger();
+  checkMultiset();
+  checkWeightBalance();
+  checkBatches();
+  checkSplitJoin();
+  checkReaders();
+  checkGeneric();
+  checkSnapshots();
+  checkAugment();
+  return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ *  Header-only RAVL (augmented with Rank AVL) trees over other key types.
+ *
+ *  RAVL_DEFINE_TREE(prefix, KeyType, CMP) generates a node type
+ *  'prefix_Node' and the functions prefix_search, prefix_insert,
+ *  prefix_delete, prefix_rank, prefix_findRank and prefix_deleteTree, with
+ *  the same contracts as their counterparts in RAVL_tree.h. CMP(a, b) must
+ *  be an expression that is negative, zero or positive as 'a' is smaller
+ *  than, equal to or larger than 'b'; it is expanded in place, so the
+ *  comparisons compile to inline code rather than an indirect call.
+ *
+ *  Specializations for int64_t, uint32_t and 16-byte keys are provided
+ *  below. The int-keyed tree in RAVL_tree.h stays the full-featured one.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RAVL_tree.h"
+
+#ifndef __RAVL_tree_generic_header
+#define __RAVL_tree_generic_header
+
+/* Three-way comparison for any scalar key type. */
+#define RAVL_CMP_SCALAR(a, b) (((a) > (b)) - ((a) < (b)))
+
+#define RAVL_DEFINE_TREE(prefix, KeyType, CMP)                                \
+  typedef struct prefix##_node {                                              \
+    KeyType key;                  /* key stored in this node */               \
+    void* value;                  /* value associated with this key */        \
+    int height;                   /* height of tree rooted at this node */    \
+    int size;                     /* size of tree rooted at this node */      \
+    struct prefix##_node* left;   /* this node's left child */                \
+    struct prefix##_node* right;  /* this node's right child */               \
+  } prefix##_Node;                                                            \
+                                                                              \
+  static inline int prefix##_height(prefix##_Node* node) {                    \
+    return node == NULL ? 0 : node->height;                                   \
+  }                                                                           \
+                                                                              \
+  static inline int prefix##_size(prefix##_Node* node) {                      \
+    return node == NULL ? 0 : node->size;                                     \
+  }                                                                           \
+                                                                              \
+  static inline void prefix##_update(prefix##_Node* node) {                   \
+    int lch = prefix##_height(node->left);                                    \
+    int rch = prefix##_height(node->right);                                   \
+    node->height = (lch > rch ? lch : rch) + 1;                               \
+    node->size = prefix##_size(node->left) + prefix##_size(node->right) + 1;  \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_rotateRight(prefix##_Node* node) {    \
+    prefix##_Node* xnode = node->left;                                        \
+    node->left = xnode->right;                                                \
+    xnode->right = node;                                                      \
+    prefix##_update(node);                                                    \
+    prefix##_update(xnode);                                                   \
+    return xnode;                                                             \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_rotateLeft(prefix##_Node* node) {     \
+    prefix##_Node* xnode = node->right;                                       \
+    node->right = xnode->left;                                                \
+    xnode->left = node;                                                       \
+    prefix##_update(node);                                                    \
+    prefix##_update(xnode);                                                   \
+    return xnode;                                                             \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_rebalance(prefix##_Node* node) {      \
+    int bafa = prefix##_height(node->left) - prefix##_height(node->right);    \
+    if (bafa > 1) {                                                           \
+      prefix##_Node* xnode = node->left;                                      \
+      if (prefix##_height(xnode->left) < prefix##_height(xnode->right)) {     \
+        node->left = prefix##_rotateLeft(xnode);                              \
+      }                                                                       \
+      return prefix##_rotateRight(node);                                      \
+    }                                                                         \
+    if (bafa < -1) {                                                          \
+      prefix##_Node* xnode = node->right;                                     \
+      if (prefix##_height(xnode->left) > prefix##_height(xnode->right)) {     \
+        node->right = prefix##_rotateRight(xnode);                            \
+      }                                                                       \
+      return prefix##_rotateLeft(node);                                       \
+    }                                                                         \
+    return node;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline void prefix##_retrace(prefix##_Node** path[], int depth,      \
+                                      int sizeDelta) {                        \
+    while (depth > 0) {                                                       \
+      prefix##_Node** link = path[--depth];                                   \
+      int oldHeight = (*link)->height;                                        \
+      prefix##_update(*link);                                                 \
+      *link = prefix##_rebalance(*link);                                      \
+      if ((*link)->height == oldHeight) {                                     \
+        break;                                                                \
+      }                                                                       \
+    }                                                                         \
+    while (depth > 0) {                                                       \
+      (*path[--depth])->size += sizeDelta;                                    \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_search(prefix##_Node* node,           \
+                                               KeyType key) {                 \
+    while (node != NULL) {                                                    \
+      int c = CMP(key, node->key);                                            \
+      if (c == 0) {                                                           \
+        return node;                                                          \
+      }                                                                       \
+      node = c < 0 ? node->left : node->right;                                \
+    }                                                                         \
+    return NULL;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_insert(prefix##_Node* node,           \
+                                               KeyType key, void* value) {    \
+    prefix##_Node** path[RAVL_MAX_HEIGHT];                                    \
+    int depth = 0;                                                            \
+    prefix##_Node* root = node;                                               \
+    prefix##_Node** link = &root;                                             \
+    while (*link != NULL) {                                                   \
+      node = *link;                                                           \
+      int c = CMP(key, node->key);                                            \
+      if (c == 0) {                                                           \
+        node->value = value;                                                  \
+        return root;                                                          \
+      }                                                                       \
+      path[depth++] = link;                                                   \
+      link = c < 0 ? &node->left : &node->right;                              \
+    }                                                                         \
+    node = (prefix##_Node*)malloc(sizeof(prefix##_Node));                     \
+    if (node == NULL) {                                                       \
+      fprintf(stderr, "Memory allocation failed for " #prefix "_Node\n");     \
+      exit(1);                                                                \
+    }                                                                         \
+    node->key = key;                                                          \
+    node->value = value;                                                      \
+    node->height = 1;                                                         \
+    node->size = 1;                                                           \
+    node->left = NULL;                                                        \
+    node->right = NULL;                                                       \
+    *link = node;                                                             \
+    prefix##_retrace(path, depth, 1);                                         \
+    return root;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_delete(prefix##_Node* node,           \
+                                               KeyType key) {                 \
+    prefix##_Node** path[RAVL_MAX_HEIGHT];                                    \
+    int depth = 0;                                                            \
+    prefix##_Node* root = node;                                               \
+    prefix##_Node** link = &root;                                             \
+    int c = 0;                                                                \
+    while (*link != NULL && (c = CMP(key, (*link)->key)) != 0) {              \
+      path[depth++] = link;                                                   \
+      link = c < 0 ? &(*link)->left : &(*link)->right;                        \
+    }                                                                         \
+    if (*link == NULL) {                                                      \
+      return root;                                                            \
+    }                                                                         \
+    node = *link;                                                             \
+    if (node->left != NULL && node->right != NULL) {                          \
+      path[depth++] = link;                                                   \
+      link = &node->right;                                                    \
+      while ((*link)->left != NULL) {                                         \
+        path[depth++] = link;                                                 \
+        link = &(*link)->left;                                                \
+      }                                                                       \
+      prefix##_Node* suc = *link;                                             \
+      node->key = suc->key;                                                   \
+      node->value = suc->value;                                               \
+      node = suc;                                                             \
+    }                                                                         \
+    *link = node->left != NULL ? node->left : node->right;                    \
+    free(node);                                                               \
+    prefix##_retrace(path, depth, -1);                                        \
+    return root;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline int prefix##_rank(prefix##_Node* node, KeyType key) {         \
+    int r = 0;                                                                \
+    while (node != NULL) {                                                    \
+      int c = CMP(key, node->key);                                            \
+      if (c == 0) {                                                           \
+        return r + prefix##_size(node->left) + 1;                             \
+      }                                                                       \
+      if (c > 0) {                                                            \
+        r += prefix##_size(node->left) + 1;                                   \
+        node = node->right;                                                   \
+      } else {                                                                \
+        node = node->left;                                                    \
+      }                                                                       \
+    }                                                                         \
+    return NOTIN;                                                             \
+  }                                                                           \
+                                                                              \
+  static inline prefix##_Node* prefix##_findRank(prefix##_Node* node,         \
+                                                 int rank) {                  \
+    if (rank <= 0) {                                                          \
+      return NULL;                                                            \
+    }                                                                         \
+    while (node != NULL) {                                                    \
+      int rank_root = prefix##_size(node->left) + 1;                          \
+      if (rank == rank_root) {                                                \
+        return node;                                                          \
+      }                                                                       \
+      if (rank_root > rank) {                                                 \
+        node = node->left;                                                    \
+      } else {                                                                \
+        rank -= rank_root;                                                    \
+        node = node->right;                                                   \
+      }                                                                       \
+    }                                                                         \
+    return NULL;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline void prefix##_deleteTree(prefix##_Node* node) {               \
+    if (node == NULL) {                                                       \
+      return;                                                                 \
+    }                                                                         \
+    prefix##_deleteTree(node->left);                                          \
+    prefix##_deleteTree(node->right);                                         \
+    free(node);                                                               \
+  }
+
+/*************************************************************************
+ ** Provided specializations
+ *************************************************************************/
+
+typedef struct ravl_key16 {
+  unsigned char bytes[16];  // compared lexicographically, as by memcmp
+} RAVL_Key16;
+
+#define RAVL_CMP_KEY16(a, b) memcmp((a).bytes, (b).bytes, sizeof((a).bytes))
+
+RAVL_DEFINE_TREE(RAVL64, int64_t, RAVL_CMP_SCALAR)
+RAVL_DEFINE_TREE(RAVLU32, uint32_t, RAVL_CMP_SCALAR)
+RAVL_DEFINE_TREE(RAVL16, RAVL_Key16, RAVL_CMP_KEY16)
+
+#endif
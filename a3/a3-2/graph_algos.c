@@ -11,6 +11,11 @@
 
 #define NOTHING -1
 #define DEBUG 0
+#define HEAP_ARITY 4  // children per node of the priority queue
+#ifndef LAZY_HEAP
+#define LAZY_HEAP 1   // 1: vertices enter the priority queue when first
+                      //   reached; 0: all of them start in it at INT_MAX
+#endif
 
 typedef struct records {
   int numVertices;    // total number of vertices in the graph
@@ -31,7 +36,8 @@ bool isEmpty(MinHeap* heap) { return heap == NULL || heap->size == 0; }
 
 /* Creates, populates, and returns a MinHeap to be used by Prim's and
  * Dijkstra's algorithms on Graph 'graph' starting from vertex with ID
- * 'startVertex'.
+ * 'startVertex'. With LAZY_HEAP, the heap starts with the start vertex
+ * alone, and the others are inserted by insertOrDecrease when reached.
  * Precondition: 'startVertex' is valid in 'graph'
  */
 MinHeap* initHeap(Graph* graph, int startVertex) {
@@ -40,19 +46,18 @@ MinHeap* initHeap(Graph* graph, int startVertex) {
   }
 
   int ver_num = graph->numVertices;
-  MinHeap* heap = newHeap(ver_num);
+#if LAZY_HEAP
+  MinHeap* heap = newDaryHeap(ver_num, HEAP_ARITY);
+#else
+  MinHeap* heap = newSourceHeap(ver_num, startVertex, HEAP_ARITY);
+#endif
   if (heap == NULL) {
     perror("Failed to allocate MinHeap");
     exit(1);
   }
-
-  for (int i = 0; i < ver_num; i++) {
-    if (i == startVertex) {
-      insert(heap, 0, i);
-    } else {
-      insert(heap, INT_MAX, i);
-    }
-  }
+#if LAZY_HEAP
+  insert(heap, 0, startVertex);
+#endif
 
   return heap;
 }
@@ -115,10 +120,39 @@ Records* initRecords(Graph* graph, int startVertex) {
     free(records);
     exit(1);
   }
+  // Prim's fills fewer than ver_num - 1 slots on a disconnected graph
+  for (int i = 0; i < ver_num; i++) {
+    records->tree[i].fromVertex = NOTHING;
+    records->tree[i].toVertex = NOTHING;
+    records->tree[i].weight = 0;
+  }
 
   return records;
 }
 
+/* Returns false if every vertex in 'records' is finished. Otherwise, with
+ * LAZY_HEAP, inserts the unfinished vertex with the smallest ID at or
+ * after '*nextVertex' into the empty heap at priority INT_MAX and returns
+ * true. This lets Prim's algorithm grow a spanning forest on a
+ * disconnected graph. The eager heap instead hands out whichever INT_MAX
+ * vertex its layout puts first, so the two modes can start a component
+ * at different vertices and orient its forest edges differently; the
+ * total weight is the same.
+ */
+bool restartHeap(Records* records, int* nextVertex) {
+#if LAZY_HEAP
+  while (*nextVertex < records->numVertices &&
+         records->finished[*nextVertex]) {
+    *nextVertex += 1;
+  }
+  if (*nextVertex < records->numVertices) {
+    insert(records->heap, INT_MAX, *nextVertex);
+    return true;
+  }
+#endif
+  return false;
+}
+
 /* Prints the status of all current algorithm data: good for debugging. */
 void printRecords(Records* records);
 
@@ -217,7 +251,8 @@ Edge* getMSTprim(Graph* graph, int startVertex) {
     exit(1);
   }
 
-  while (!isEmpty(records->heap)) {
+  int nextVertex = 0;
+  while (!isEmpty(records->heap) || restartHeap(records, &nextVertex)) {
     HeapNode u = extractMin(records->heap);
     int uid = u.id;
     records->finished[uid] = true;
@@ -237,8 +272,7 @@ Edge* getMSTprim(Graph* graph, int startVertex) {
       int weight_uv = u_adj->edge->weight;
 
       if (!records->finished[vid] &&
-          weight_uv < getPriority(records->heap, vid)) {
-        decreasePriority(records->heap, vid, weight_uv);
+          insertOrDecrease(records->heap, vid, weight_uv)) {
         records->predecessors[vid] = uid;
       }
 
@@ -271,6 +305,9 @@ Edge* getDistanceTreeDijkstra(Graph* graph, int startVertex) {
     HeapNode u = extractMin(records->heap);
     int uid = u.id;
     int u_dist = u.priority;
+    if (u_dist == INT_MAX) {
+      break;  // the start vertex cannot reach the rest of the heap
+    }
     records->finished[uid] = true;
 
     if (uid == startVertex) {
@@ -287,8 +324,7 @@ Edge* getDistanceTreeDijkstra(Graph* graph, int startVertex) {
       int new_dist = u_dist + weight_uv;
 
       if (!records->finished[vid] &&
-          new_dist < getPriority(records->heap, vid)) {
-        decreasePriority(records->heap, vid, new_dist);
+          insertOrDecrease(records->heap, vid, new_dist)) {
         records->predecessors[vid] = uid;
       }
 
@@ -296,6 +332,13 @@ Edge* getDistanceTreeDijkstra(Graph* graph, int startVertex) {
     }
   }
 
+  // unreachable vertices have no predecessor and an infinite distance
+  for (int i = 0; i < records->numVertices; i++) {
+    if (!records->finished[i]) {
+      addTreeEdge(records, i, i, NOTHING, INT_MAX);
+    }
+  }
+
   Edge* result = records->tree;
 
   free(records->finished);
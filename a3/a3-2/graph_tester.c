@@ -11,8 +11,11 @@
  *
  *   Run:
  *   ./tester sample_input.txt
+ *   ./tester disconnected_input.txt
  *
- *   SEE FILE expected_output.txt FOR EXPECTED OUTPUT
+ *   SEE FILES sample_output.txt AND disconnected_output.txt FOR EXPECTED
+ *   OUTPUT. Built with -DLAZY_HEAP=0, Prim's may start a component at
+ *   another vertex; compare against disconnected_output_eager.txt then.
  *
  *   Don't forget:
  *   valgrind --show-leak-kinds=all --leak-check=full ./tester sample_input.txt
@@ -4,10 +4,29 @@
  * Author (starter code): A. Tafliovich.
  */
 
+#include <limits.h>
+#include <string.h>
+
 #include "minheap.h"
 
-#define ROOT_INDEX 1
 #define NOTHING -1
+#define CACHE_LINE 64  // alignment of the heap array, in bytes
+
+/* The helpers below trust their callers; compile with -DMINHEAP_DEBUG to
+ * have them validate every index they are given, and to check the whole
+ * heap after every update.
+ */
+#ifdef MINHEAP_DEBUG
+#define DEBUG_CHECK(condition, message)    \
+  do {                                     \
+    if (!(condition)) {                    \
+      fprintf(stderr, "%s\n", (message)); \
+      exit(1);                             \
+    }                                      \
+  } while (0)
+#else
+#define DEBUG_CHECK(condition, message) ((void)0)
+#endif
 
 typedef struct min_node {
   int priority;   // the smaller priority of two child node
@@ -37,11 +56,165 @@ int priorityAt(MinHeap* heap, int nodeIndex) {
  */
 int idAt(MinHeap* heap, int nodeIndex) { return heap->arr[nodeIndex].id; }
 
-/* Returns index of node with ID 'id' in minheap 'heap'.
- * Precondition: 'id' is a valid ID in 'heap'
- *               'heap' is non-empty
+/* Returns the slot of the sparse index map of minheap 'heap' where the
+ * probe sequence for ID 'id' starts.
+ */
+unsigned int homeSlot(MinHeap* heap, int id) {
+  unsigned int hash = (unsigned int)id * 2654435769u;  // Fibonacci hashing
+  return (hash ^ (hash >> 16)) & ((unsigned int)heap->numSlots - 1);
+}
+
+/* Returns the slot of the sparse index map of minheap 'heap' that holds ID
+ * 'id', or the empty slot where it would be stored.
+ */
+int slotOf(MinHeap* heap, int id) {
+  unsigned int mask = (unsigned int)heap->numSlots - 1;
+  unsigned int slot = homeSlot(heap, id);
+  while (heap->idSlots[slot].id != NOTHING && heap->idSlots[slot].id != id) {
+    slot = (slot + 1) & mask;
+  }
+  return (int)slot;
+}
+
+/* Returns index of node with ID 'id' in minheap 'heap', or NOTHING if there
+ * is no such node.
+ * Precondition: 'id' >= 0
  */
-int indexOf(MinHeap* heap, int id) { return heap->indexMap[id]; }
+int indexOf(MinHeap* heap, int id) {
+  if (heap->idSlots != NULL) {
+    IdSlot* slot = &heap->idSlots[slotOf(heap, id)];
+    return slot->id == id ? slot->index : NOTHING;
+  }
+  if (id >= heap->idCapacity) {
+    return NOTHING;
+  }
+  return heap->indexMap[id];
+}
+
+/* Doubles the number of slots in the sparse index map of minheap 'heap'. */
+void growSlots(MinHeap* heap) {
+  IdSlot* oldSlots = heap->idSlots;
+  int oldNumSlots = heap->numSlots;
+  heap->numSlots = 2 * oldNumSlots;
+  heap->idSlots = malloc(heap->numSlots * sizeof(IdSlot));
+  if (!heap->idSlots) {
+    fprintf(stderr, "Memory allocation failed for the index table\n");
+    exit(1);
+  }
+  for (int i = 0; i < heap->numSlots; ++i) {
+    heap->idSlots[i].id = NOTHING;
+  }
+  for (int i = 0; i < oldNumSlots; ++i) {
+    if (oldSlots[i].id != NOTHING) {
+      heap->idSlots[slotOf(heap, oldSlots[i].id)] = oldSlots[i];
+    }
+  }
+  free(oldSlots);
+}
+
+/* Grows the dense index map of minheap 'heap' to cover ID 'id', at least
+ * doubling it.
+ */
+void growIndexMap(MinHeap* heap, int id) {
+  int newCapacity = 2 * heap->idCapacity;
+  if (newCapacity <= id) {
+    newCapacity = id + 1;
+  }
+  int* newMap = realloc(heap->indexMap, newCapacity * sizeof(int));
+  if (!newMap) {
+    fprintf(stderr, "Memory allocation failed for the index array\n");
+    exit(1);
+  }
+  for (int i = heap->idCapacity; i < newCapacity; ++i) {
+    newMap[i] = NOTHING;
+  }
+  heap->indexMap = newMap;
+  heap->idCapacity = newCapacity;
+}
+
+/* Records that the node with ID 'id' is at index 'index' in minheap 'heap'.
+ * Precondition: 'id' >= 0
+ */
+void setIndex(MinHeap* heap, int id, int index) {
+  if (heap->idSlots == NULL) {
+    if (id >= heap->idCapacity) {
+      growIndexMap(heap, id);
+    }
+    heap->indexMap[id] = index;
+    return;
+  }
+  int slot = slotOf(heap, id);
+  if (heap->idSlots[slot].id == NOTHING) {
+    // keep the table at most half full so probe sequences stay short
+    if (2 * (heap->usedSlots + 1) > heap->numSlots) {
+      growSlots(heap);
+      slot = slotOf(heap, id);
+    }
+    heap->usedSlots += 1;
+    heap->idSlots[slot].id = id;
+  }
+  heap->idSlots[slot].index = index;
+}
+
+/* Forgets the index of the node with ID 'id' in minheap 'heap', if any. */
+void clearIndex(MinHeap* heap, int id) {
+  if (heap->idSlots == NULL) {
+    if (id < heap->idCapacity) {
+      heap->indexMap[id] = NOTHING;
+    }
+    return;
+  }
+  unsigned int mask = (unsigned int)heap->numSlots - 1;
+  unsigned int hole = (unsigned int)slotOf(heap, id);
+  if (heap->idSlots[hole].id == NOTHING) {
+    return;
+  }
+  // shift later entries of the probe sequence back, so no tombstone is left
+  unsigned int next = (hole + 1) & mask;
+  while (heap->idSlots[next].id != NOTHING) {
+    unsigned int home = homeSlot(heap, heap->idSlots[next].id);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      heap->idSlots[hole] = heap->idSlots[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  heap->idSlots[hole].id = NOTHING;
+  heap->usedSlots -= 1;
+}
+
+/* Returns the index of the root of minheap 'heap'. Indices below it are
+ * unused, so that each group of siblings starts at a multiple of the arity.
+ */
+int rootIdx(MinHeap* heap) { return heap->arity - 1; }
+
+/* Returns the index of the last node of minheap 'heap'. */
+int lastIdx(MinHeap* heap) { return heap->size + heap->arity - 2; }
+
+/* Returns a cache-line aligned array for minheap 'heap' with room for
+ * 'capacity' nodes.
+ */
+HeapNode* allocArray(MinHeap* heap, int capacity) {
+  size_t bytes = (size_t)(capacity + heap->arity - 1) * sizeof(HeapNode);
+  bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  return aligned_alloc(CACHE_LINE, bytes);
+}
+
+/* Doubles the capacity of the array of minheap 'heap'. realloc would not
+ * keep the alignment, so the nodes are copied to a new array.
+ */
+void growArray(MinHeap* heap) {
+  int newCapacity = heap->capacity > 0 ? 2 * heap->capacity : 1;
+  HeapNode* newArr = allocArray(heap, newCapacity);
+  if (!newArr) {
+    fprintf(stderr, "Memory allocation failed for the heaparray!\n");
+    exit(1);
+  }
+  memcpy(newArr, heap->arr, (size_t)(lastIdx(heap) + 1) * sizeof(HeapNode));
+  free(heap->arr);
+  heap->arr = newArr;
+  heap->capacity = newCapacity;
+}
 
 /* Returns True if 'maybeIdx' is a valid index in minheap 'heap', and 'heap'
  * stores an element at that index. Returns False otherwise.
@@ -50,11 +223,11 @@ bool isValidIndex(MinHeap* heap, int maybeIdx) {
   if (heap == NULL) {
     return false;
   }
-  if (maybeIdx < 1 || maybeIdx > heap->size) {
+  if (maybeIdx < rootIdx(heap) || maybeIdx > lastIdx(heap)) {
     return false;
   }
   int maybeId = idAt(heap, maybeIdx);
-  if (maybeId < 0 || maybeId >= heap->capacity) {
+  if (maybeId < 0) {
     return false;
   }
   if (indexOf(heap, maybeId) != maybeIdx) {
@@ -63,180 +236,245 @@ bool isValidIndex(MinHeap* heap, int maybeIdx) {
   return true;
 }
 
-/* Returns the index of the left child of a node at index 'nodeIndex' in
- * minheap 'heap', if such exists.  Returns NOTHING if there is no such left
- * child.
+/* Returns True if 'nodeIndex' lies within the occupied part of the array of
+ * minheap 'heap'. Unlike isValidIndex, this holds for the hole left while an
+ * element is being sifted.
  */
-int leftIdx(MinHeap* heap, int nodeIndex) {
-  if (!isValidIndex(heap, nodeIndex)) {
-    fprintf(stderr, "Invalid nodeIndex or heap does not exist\n");
-    exit(1);
-  }
-  int left_child = 2 * nodeIndex;
-  if (left_child > heap->size) {
-    return NOTHING;
-  }
-  return left_child;
+bool isInHeap(MinHeap* heap, int nodeIndex) {
+  return heap != NULL && nodeIndex >= rootIdx(heap) &&
+         nodeIndex <= lastIdx(heap);
 }
 
-/* Returns the index of the right child of a node at index 'nodeIndex' in
- * minheap 'heap', if such exists.  Returns NOTHING if there is no such right
- * child.
+/* Returns the index of the first child of a node at index 'nodeIndex' in
+ * minheap 'heap', if such exists; its other children follow it. Returns
+ * NOTHING if the node has no children.
  */
-int rightIdx(MinHeap* heap, int nodeIndex) {
-  if (!isValidIndex(heap, nodeIndex)) {
-    fprintf(stderr, "Invalid nodeIndex or heap does not exist\n");
-    exit(1);
-  }
-  int right_child = 2 * nodeIndex + 1;
-  if (right_child > heap->size) {
+int firstChildIdx(MinHeap* heap, int nodeIndex) {
+  DEBUG_CHECK(isInHeap(heap, nodeIndex),
+              "Invalid nodeIndex or heap does not exist");
+  int first_child = heap->arity * (nodeIndex - heap->arity + 2);
+  if (first_child > lastIdx(heap)) {
     return NOTHING;
   }
-  return right_child;
+  return first_child;
 }
 
 /* Returns the index of the parent of a node at index 'nodeIndex' in minheap
  * 'heap', if such exists.  Returns NOTHING if there is no such parent.
  */
 int parentIdx(MinHeap* heap, int nodeIndex) {
-  if (!isValidIndex(heap, nodeIndex)) {
-    fprintf(stderr, "Invalid nodeIndex or heap does not exist\n");
-    exit(1);
-  }
-  if (nodeIndex == ROOT_INDEX) {
+  DEBUG_CHECK(isInHeap(heap, nodeIndex),
+              "Invalid nodeIndex or heap does not exist");
+  if (nodeIndex == rootIdx(heap)) {
     return NOTHING;
   }
-  return nodeIndex / 2;
+  return nodeIndex / heap->arity + heap->arity - 2;
 }
 
-/* Swaps contents of heap->arr[index1] and heap->arr[index2] if both 'index1'
- * and 'index2' are valid indices for minheap 'heap'. Has no effect
- * otherwise.
+/* Returns True if every index of minheap 'heap' is valid and every node's
+ * priority is at least its parent's. Takes O(size); for debugging only.
  */
-void swap(MinHeap* heap, int index1, int index2) {
-  if (!isValidIndex(heap, index1) || !isValidIndex(heap, index2)) {
-    return;
+bool isValidHeap(MinHeap* heap) {
+  for (int i = rootIdx(heap); i <= lastIdx(heap); i++) {
+    if (!isValidIndex(heap, i)) {
+      return false;
+    }
+    if (i != rootIdx(heap) &&
+        priorityAt(heap, parentIdx(heap, i)) > priorityAt(heap, i)) {
+      return false;
+    }
   }
-  HeapNode temp_container = nodeAt(heap, index1);
-  heap->arr[index1] = nodeAt(heap, index2);
-  heap->arr[index2] = temp_container;
-  heap->indexMap[idAt(heap, index1)] = index1;
-  heap->indexMap[idAt(heap, index2)] = index2;
+  return true;
+}
+
+/* Stores node 'node' at index 'nodeIndex' of minheap 'heap' and records its
+ * new index.
+ */
+void placeNode(MinHeap* heap, int nodeIndex, HeapNode node) {
+  heap->arr[nodeIndex] = node;
+  setIndex(heap, node.id, nodeIndex);
 }
 
 /* Bubbles up the element newly inserted into minheap 'heap' at index
- * 'nodeIndex', if 'nodeIndex' is a valid index for heap. Has no effect
- * otherwise.
+ * 'nodeIndex'. Larger ancestors are shifted down into the hole it leaves,
+ * and the element is written once, where it stops.
+ * Precondition: 'nodeIndex' is a valid index for heap
  */
 void bubbleUp(MinHeap* heap, int nodeIndex) {
-  if (!isValidIndex(heap, nodeIndex)) {
-    return;
-  }
+  DEBUG_CHECK(isInHeap(heap, nodeIndex),
+              "Invalid nodeIndex or heap does not exist");
+  HeapNode node = nodeAt(heap, nodeIndex);
   int parentIndex = parentIdx(heap, nodeIndex);
-  while (parentIndex != NOTHING && isValidIndex(heap, nodeIndex) &&
-         priorityAt(heap, nodeIndex) < priorityAt(heap, parentIndex)) {
-    swap(heap, nodeIndex, parentIndex);
+  while (parentIndex != NOTHING &&
+         node.priority < priorityAt(heap, parentIndex)) {
+    placeNode(heap, nodeIndex, nodeAt(heap, parentIndex));
     nodeIndex = parentIndex;
     parentIndex = parentIdx(heap, nodeIndex);
   }
+  placeNode(heap, nodeIndex, node);
 }
 
-/*Find the node with smaller priority between the two child nodes of
- *the node at index 'nodeIndex' in minheap 'heap'.
+/*Find the node with smallest priority among the children of the node at
+ *index 'nodeIndex' in minheap 'heap'.
  *If no child, then use the its priority and index.
  */
 MinNode find_min(MinHeap* heap, int nodeIndex) {
-  if (!isValidIndex(heap, nodeIndex)) {
-    fprintf(stderr, "Invalid nodeIndex or the heap is not exist\n");
-    exit(1);
-  }
-  int left_child = leftIdx(heap, nodeIndex);
-  int right_child = rightIdx(heap, nodeIndex);
+  DEBUG_CHECK(isInHeap(heap, nodeIndex),
+              "Invalid nodeIndex or the heap is not exist");
+  int first_child = firstChildIdx(heap, nodeIndex);
   MinNode result;
-  if (left_child == NOTHING) {
+  if (first_child == NOTHING) {
     result.priority = priorityAt(heap, nodeIndex);
     result.nodeIndex = nodeIndex;
     return result;
   }
-  if (right_child == NOTHING) {
-    result.priority = priorityAt(heap, left_child);
-    result.nodeIndex = left_child;
-    return result;
+  int end = first_child + heap->arity;
+  if (end > lastIdx(heap) + 1) {
+    end = lastIdx(heap) + 1;
   }
-  if (priorityAt(heap, left_child) < priorityAt(heap, right_child)) {
-    result.priority = priorityAt(heap, left_child);
-    result.nodeIndex = left_child;
-    return result;
+  // the siblings share a cache line; selects instead of branches let the
+  // compiler turn this scan into conditional moves or vector code
+  result.priority = priorityAt(heap, first_child);
+  result.nodeIndex = first_child;
+  for (int child = first_child + 1; child < end; child++) {
+    int priority = heap->arr[child].priority;
+    bool smaller = priority < result.priority;
+    result.priority = smaller ? priority : result.priority;
+    result.nodeIndex = smaller ? child : result.nodeIndex;
   }
-  result.priority = priorityAt(heap, right_child);
-  result.nodeIndex = right_child;
   return result;
 }
 
-/* Bubbles down the element newly inserted into minheap 'heap' at the root,
- * if it exists. Has no effect otherwise.
+/* Bubbles down the element at index 'nodeIndex' of minheap 'heap', if the
+ * heap is non-empty. Smaller children are shifted up into the hole it
+ * leaves, and the element is written once, where it stops.
+ * Precondition: the subtrees below 'nodeIndex' satisfy the heap property
  */
-void bubbleDown(MinHeap* heap) {
-  if (heap == NULL || heap->size < 1) {
+void bubbleDown(MinHeap* heap, int nodeIndex) {
+  if (heap->size < 1) {
     return;
   }
-  int nodeIndex = ROOT_INDEX;
-  MinNode min_node_info = find_min(heap, nodeIndex);
-  while (isValidIndex(heap, nodeIndex) &&
-         priorityAt(heap, nodeIndex) > min_node_info.priority) {
-    swap(heap, nodeIndex, min_node_info.nodeIndex);
+  DEBUG_CHECK(isInHeap(heap, nodeIndex),
+              "Invalid nodeIndex or heap does not exist");
+  HeapNode node = nodeAt(heap, nodeIndex);
+  while (firstChildIdx(heap, nodeIndex) != NOTHING) {
+    MinNode min_node_info = find_min(heap, nodeIndex);
+    if (min_node_info.priority >= node.priority) {
+      break;
+    }
+    placeNode(heap, nodeIndex, nodeAt(heap, min_node_info.nodeIndex));
     nodeIndex = min_node_info.nodeIndex;
-    min_node_info = find_min(heap, nodeIndex);
   }
+  placeNode(heap, nodeIndex, node);
 }
+
+/* Exits with an error unless minheap 'heap' exists and is non-empty. */
+void requireNonEmpty(MinHeap* heap) {
+  if (heap == NULL || heap->size < 1) {
+    fprintf(stderr, "The heap is empty or does not exist\n");
+    exit(1);
+  }
+}
+
 /*********************************************************************
  * Required functions
+ * Preconditions are checked here, once per call; the helpers above
+ * only re-check them in MINHEAP_DEBUG builds.
  ********************************************************************/
-HeapNode getMin(MinHeap* heap) { return nodeAt(heap, ROOT_INDEX); }
+HeapNode getMin(MinHeap* heap) {
+  requireNonEmpty(heap);
+  return nodeAt(heap, rootIdx(heap));
+}
 
 HeapNode extractMin(MinHeap* heap) {
   HeapNode minNode = getMin(heap);
-  heap->arr[1] = nodeAt(heap, heap->size);
-  heap->indexMap[idAt(heap, ROOT_INDEX)] = ROOT_INDEX;
+  clearIndex(heap, minNode.id);
+  int root = rootIdx(heap);
+  heap->arr[root] = nodeAt(heap, lastIdx(heap));
   heap->size -= 1;
-  bubbleDown(heap);
+  bubbleDown(heap, root);
+  DEBUG_CHECK(isValidHeap(heap), "Heap property violated");
   return minNode;
 }
 
-void insert(MinHeap* heap, int priority, int id) {
+/* Appends a node with priority 'priority' and ID 'id' to minheap 'heap' and
+ * bubbles it up.
+ * Precondition: 'id' >= 0 and is not in 'heap'
+ */
+void appendNode(MinHeap* heap, int priority, int id) {
+  if (heap->size == heap->capacity) {
+    growArray(heap);
+  }
   heap->size += 1;
-  int nodeIndex = heap->size;
+  int nodeIndex = lastIdx(heap);
   heap->arr[nodeIndex].priority = priority;
   heap->arr[nodeIndex].id = id;
-  heap->indexMap[id] = nodeIndex;
   bubbleUp(heap, nodeIndex);
+  DEBUG_CHECK(isValidHeap(heap), "Heap property violated");
+}
+
+/* Lowers the priority of the node at index 'index' of minheap 'heap' to
+ * 'newPriority' and returns True, if that is lower than its priority.
+ * Has no effect and returns False, otherwise.
+ * Precondition: 'index' is a valid index in 'heap'
+ */
+bool lowerPriorityAt(MinHeap* heap, int index, int newPriority) {
+  if (priorityAt(heap, index) <= newPriority) {
+    return false;
+  }
+  heap->arr[index].priority = newPriority;
+  bubbleUp(heap, index);
+  DEBUG_CHECK(isValidHeap(heap), "Heap property violated");
+  return true;
+}
+
+void insert(MinHeap* heap, int priority, int id) {
+  if (heap == NULL || id < 0 || indexOf(heap, id) != NOTHING) {
+    fprintf(stderr, "Invalid or duplicate id!\n");
+    exit(1);
+  }
+  appendNode(heap, priority, id);
 }
 
 int getPriority(MinHeap* heap, int id) {
-  int index = indexOf(heap, id);
+  int index = heap == NULL || id < 0 ? NOTHING : indexOf(heap, id);
+  if (index == NOTHING) {
+    fprintf(stderr, "Invalid id!\n");
+    exit(1);
+  }
   return priorityAt(heap, index);
 }
 
 bool decreasePriority(MinHeap* heap, int id, int newPriority) {
-  if (heap == NULL || id < 0 || id >= heap->capacity) {
+  if (heap == NULL || id < 0) {
     fprintf(stderr, "Invalid id!\n");
     return false;
   }
   int index = indexOf(heap, id);
-  if (!isValidIndex(heap, index)) {
+  if (index == NOTHING) {
     fprintf(stderr, "Invalid id index!\n");
     return false;
   }
-  int oldPriority = getPriority(heap, id);
-  if (oldPriority <= newPriority) {
+  return lowerPriorityAt(heap, index, newPriority);
+}
+
+bool insertOrDecrease(MinHeap* heap, int id, int priority) {
+  if (heap == NULL || id < 0) {
+    fprintf(stderr, "Invalid id!\n");
     return false;
   }
-  heap->arr[index].priority = newPriority;
-  bubbleUp(heap, index);
-  return true;
+  int index = indexOf(heap, id);
+  if (index == NOTHING) {
+    appendNode(heap, priority, id);
+    return true;
+  }
+  return lowerPriorityAt(heap, index, priority);
 }
 
-MinHeap* newHeap(int capacity) {
+/* Returns a newly created empty 'arity'-ary minheap with initial capacity
+ * 'capacity' and no index map yet.
+ */
+MinHeap* allocHeap(int capacity, int arity) {
   MinHeap* heap = malloc(sizeof(MinHeap));
   if (!heap) {
     fprintf(stderr, "Memory allocation failed for MinHeap\n");
@@ -244,12 +482,25 @@ MinHeap* newHeap(int capacity) {
   }
   heap->size = 0;
   heap->capacity = capacity;
-  heap->arr = malloc((capacity + 1) * sizeof(HeapNode));
+  heap->arity = arity;
+  heap->arr = allocArray(heap, capacity);
   if (!heap->arr) {
     fprintf(stderr, "Memory allocation failed for the heaparray!\n");
     free(heap);
     exit(1);
   }
+  heap->indexMap = NULL;
+  heap->idCapacity = 0;
+  heap->idSlots = NULL;
+  heap->numSlots = 0;
+  heap->usedSlots = 0;
+  return heap;
+}
+
+MinHeap* newHeap(int capacity) { return newDaryHeap(capacity, 2); }
+
+MinHeap* newDaryHeap(int capacity, int arity) {
+  MinHeap* heap = allocHeap(capacity, arity);
   heap->indexMap = malloc(capacity * sizeof(int));
   if (!heap->indexMap) {
     fprintf(stderr, "Memory allocation failed for the index array\n");
@@ -257,18 +508,87 @@ MinHeap* newHeap(int capacity) {
     free(heap);
     exit(1);
   }
+  heap->idCapacity = capacity;
   for (int i = 0; i < capacity; ++i) {
     heap->indexMap[i] = NOTHING;
   }
   return heap;
 }
 
+MinHeap* newSparseHeap(int capacity) {
+  MinHeap* heap = allocHeap(capacity, 2);
+  heap->numSlots = 8;
+  while (heap->numSlots < 2 * capacity) {
+    heap->numSlots *= 2;
+  }
+  heap->idSlots = malloc(heap->numSlots * sizeof(IdSlot));
+  if (!heap->idSlots) {
+    fprintf(stderr, "Memory allocation failed for the index table\n");
+    free(heap->arr);
+    free(heap);
+    exit(1);
+  }
+  for (int i = 0; i < heap->numSlots; ++i) {
+    heap->idSlots[i].id = NOTHING;
+  }
+  return heap;
+}
+
+MinHeap* buildHeap(int* priorities, int* ids, int n) {
+  return buildDaryHeap(priorities, ids, n, 2);
+}
+
+MinHeap* buildDaryHeap(int* priorities, int* ids, int n, int arity) {
+  MinHeap* heap = newDaryHeap(n, arity);
+  int root = rootIdx(heap);
+  for (int i = 0; i < n; i++) {
+    if (ids[i] < 0 || indexOf(heap, ids[i]) != NOTHING) {
+      fprintf(stderr, "Invalid or duplicate id!\n");
+      exit(1);
+    }
+    heap->arr[root + i].priority = priorities[i];
+    heap->arr[root + i].id = ids[i];
+    setIndex(heap, ids[i], root + i);
+  }
+  heap->size = n;
+  // Floyd's heapify: sift down every internal node, deepest first; the
+  // sifts record the new index of every node they move
+  if (n > 1) {
+    for (int i = parentIdx(heap, lastIdx(heap)); i >= root; i--) {
+      bubbleDown(heap, i);
+    }
+  }
+  DEBUG_CHECK(isValidHeap(heap), "Heap property violated");
+  return heap;
+}
+
+MinHeap* newSourceHeap(int numIds, int source, int arity) {
+  if (source < 0 || source >= numIds) {
+    fprintf(stderr, "Invalid source id!\n");
+    exit(1);
+  }
+  MinHeap* heap = newDaryHeap(numIds, arity);
+  int root = rootIdx(heap);
+  for (int i = 0; i < numIds; i++) {
+    heap->arr[root + i].priority = INT_MAX;
+    heap->arr[root + i].id = i;
+    heap->indexMap[i] = root + i;
+  }
+  heap->size = numIds;
+  // all other priorities are equal, so only the source can be out of place
+  heap->arr[root + source].priority = 0;
+  bubbleUp(heap, root + source);
+  DEBUG_CHECK(isValidHeap(heap), "Heap property violated");
+  return heap;
+}
+
 void deleteHeap(MinHeap* heap) {
   if (heap == NULL) {
     return;
   }
   free(heap->arr);
   free(heap->indexMap);
+  free(heap->idSlots);
   free(heap);
 }
 /*********************************************************************
@@ -278,10 +598,11 @@ void printHeap(MinHeap* heap) {
   printf("MinHeap with size: %d\n\tcapacity: %d\n\n", heap->size,
          heap->capacity);
   printf("index: priority [ID]\t ID: index\n");
+  int slots = heap->capacity + rootIdx(heap);
   for (int i = 0; i < heap->capacity; i++)
     printf("%d: %d [%d]\t\t%d: %d\n", i, priorityAt(heap, i), idAt(heap, i), i,
            indexOf(heap, i));
-  printf("%d: %d [%d]\t\t\n", heap->capacity, priorityAt(heap, heap->capacity),
-         idAt(heap, heap->capacity));
+  for (int i = heap->capacity; i < slots; i++)
+    printf("%d: %d [%d]\t\t\n", i, priorityAt(heap, i), idAt(heap, i));
   printf("\n\n");
 }
@@ -19,11 +19,27 @@ typedef struct heap_node {
   int id;        // the unique ID of this node
 } HeapNode;
 
+typedef struct id_slot {
+  int id;     // ID stored in this slot; -1 if the slot is empty
+  int index;  // index of the node with this ID in the heap array
+} IdSlot;
+
 typedef struct min_heap {
-  int size;       // the number of nodes in this heap; 0 <= size <= capacity
-  int capacity;   // the number of nodes that can be stored in this heap
-  HeapNode* arr;  // the array that stores the nodes of this heap
-  int* indexMap;  // indexMap[id] is the index of node with ID id in array arr
+  int size;         // the number of nodes in this heap; 0 <= size <= capacity
+  int capacity;     // the number of nodes that can be stored in this heap
+                    //   before its array grows
+  HeapNode* arr;    // the array that stores the nodes of this heap, from
+                    //   index arity - 1 on, aligned to a cache line
+  int arity;        // the number of children of each node; the children of
+                    //   the node at index i are at arity * (i - arity + 2)
+                    //   and the arity - 1 indices after it
+  int* indexMap;    // indexMap[id] is the index of node with ID id in array
+                    //   arr, or -1; NULL in a sparse heap
+  int idCapacity;   // number of IDs covered by indexMap
+  IdSlot* idSlots;  // sparse heaps only: open-addressed table from ID to
+                    //   index, with a power-of-two number of slots
+  int numSlots;     // number of slots in idSlots
+  int usedSlots;    // number of slots in idSlots that hold an ID
 } MinHeap;
 
 /* Returns the node with minimum priority in minheap 'heap'.
@@ -37,9 +53,9 @@ HeapNode getMin(MinHeap* heap);
 HeapNode extractMin(MinHeap* heap);
 
 /* Inserts a new node with priority 'priority' and ID 'id' into minheap 'heap'.
+ * The heap array doubles when full, and the index map grows to cover 'id'.
  * Precondition: 'id' is unique within this minheap
- *               0 <= 'id' < heap->capacity
- *               heap->size < heap->capacity
+ *               0 <= 'id'
  */
 void insert(MinHeap* heap, int priority, int id);
 
@@ -55,16 +71,69 @@ int getPriority(MinHeap* heap, int id);
  */
 bool decreasePriority(MinHeap* heap, int id, int newPriority);
 
+/* Inserts a node with priority 'priority' and ID 'id' into minheap 'heap'
+ * if there is none with that ID, or else lowers that node's priority to
+ * 'priority' if it is larger. Returns True if the heap changed, and False
+ * otherwise. An absent ID thus behaves like one with priority INT_MAX, so
+ * a search can insert nodes as it first reaches them.
+ * Precondition: 'id' >= 0
+ */
+bool insertOrDecrease(MinHeap* heap, int id, int priority);
+
 /* Prints the contents of this heap, including size, capacity, full index
  * map, and, for each non-empty element of the heap array, that node's ID and
  * priority. */
 void printHeap(MinHeap* heap);
 
 /* Returns a newly created empty minheap with initial capacity 'capacity'.
+ * Its index map is an array indexed by ID, so it costs memory in proportion
+ * to the largest ID inserted.
  * Precondition: capacity >= 0
  */
 MinHeap* newHeap(int capacity);
 
+/* Returns a newly created empty minheap with initial capacity 'capacity'
+ * in which every node has up to 'arity' children, stored next to each other
+ * so that each group of siblings shares a cache line when 'arity' is 4 or 8.
+ * Shallower trees make extractMin touch fewer cache lines, at the price of
+ * more comparisons per level. newHeap(capacity) is newDaryHeap(capacity, 2).
+ * Precondition: capacity >= 0
+ *               arity >= 2
+ */
+MinHeap* newDaryHeap(int capacity, int arity);
+
+/* Returns a newly created empty minheap with initial capacity 'capacity'
+ * whose index map is a hash table, so it costs memory in proportion to the
+ * number of nodes in the heap rather than to the largest ID. Suits large,
+ * sparse ID spaces.
+ * Precondition: capacity >= 0
+ */
+MinHeap* newSparseHeap(int capacity);
+
+/* Returns a newly created minheap holding the 'n' nodes with priorities
+ * 'priorities[i]' and IDs 'ids[i]', built bottom-up in O(n) time rather
+ * than by 'n' calls to insert. Its index map is dense, as in newHeap.
+ * Precondition: n >= 0
+ *               the IDs in 'ids' are unique and non-negative
+ */
+MinHeap* buildHeap(int* priorities, int* ids, int n);
+
+/* Same as buildHeap, but every node of the new minheap has up to 'arity'
+ * children, as in newDaryHeap.
+ * Precondition: arity >= 2
+ */
+MinHeap* buildDaryHeap(int* priorities, int* ids, int n, int arity);
+
+/* Returns a newly created 'arity'-ary minheap holding the nodes with IDs
+ * 0, 1, ..., numIds - 1, all with priority INT_MAX except node 'source',
+ * which has priority 0: the starting queue of a shortest-path search. Takes
+ * O(numIds) time, and leaves the nodes where 'numIds' calls to insert
+ * would have.
+ * Precondition: 0 <= source < numIds
+ *               arity >= 2
+ */
+MinHeap* newSourceHeap(int numIds, int source, int arity);
+
 /* Frees all memory allocated for minheap 'heap'.
  */
 void deleteHeap(MinHeap* heap);
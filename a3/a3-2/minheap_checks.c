@@ -0,0 +1,152 @@
+/*
+ *  Non-interactive checks of our MinHeap implementation, beyond what the
+ *  graph tester reaches. Every check prints one line; the output is
+ *  deterministic, so a run can be compared against the expected output.
+ *
+ *  Compile:
+ *   gcc -g -Wall -Werror minheap.c minheap_checks.c -o checks
+ *
+ *  Run:
+ *   ./checks > checks_out.txt
+ *   diff checks_out.txt checks_output.txt
+ *
+ *  Don't forget:
+ *   valgrind --show-leak-kinds=all --leak-check=full ./checks
+ *   gcc -DMINHEAP_DEBUG ... to check the heap after every update
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "minheap.h"
+
+#define MAX_IDS 512  // IDs used by a check are ids[0..MAX_IDS)
+#define CHURN_OPS 200000
+
+/* Returns the smallest priority in 'priorities' among the IDs marked in
+ * 'present', or INT_MAX if none is.
+ */
+int referenceMin(int* priorities, bool* present) {
+  int best = INT_MAX;
+  for (int i = 0; i < MAX_IDS; i++) {
+    if (present[i] && priorities[i] < best) {
+      best = priorities[i];
+    }
+  }
+  return best;
+}
+
+/* Runs CHURN_OPS random inserts, decreases and extractMins on 'heap', with
+ * IDs ids[0..MAX_IDS), checking every result against a plain array, and
+ * prints whether they all matched. Extracted IDs are reinserted later, so a
+ * sparse index keeps deleting and reusing slots.
+ */
+void churn(const char* label, MinHeap* heap, int* ids, unsigned int seed) {
+  int priorities[MAX_IDS];
+  bool present[MAX_IDS] = {false};
+  int inHeap = 0;
+  bool ok = true;
+  for (int op = 0; op < CHURN_OPS; op++) {
+    seed = seed * 1103515245u + 12345u;
+    int i = (int)(seed >> 16) % MAX_IDS;
+    int priority = (int)(seed >> 4) % 100000;
+    int kind = (int)(seed >> 28) % 3;
+    if (kind == 0 && !present[i]) {
+      insert(heap, priority, ids[i]);
+      priorities[i] = priority;
+      present[i] = true;
+      inHeap++;
+    } else if (kind == 1 && present[i]) {
+      bool lowered = priority < priorities[i];
+      if (decreasePriority(heap, ids[i], priority) != lowered) {
+        ok = false;
+      }
+      if (lowered) {
+        priorities[i] = priority;
+      }
+    } else if (kind == 2 && inHeap > 0) {
+      HeapNode min = extractMin(heap);
+      int j = 0;
+      while (j < MAX_IDS && !(present[j] && ids[j] == min.id)) {
+        j++;
+      }
+      if (j == MAX_IDS || min.priority != referenceMin(priorities, present)) {
+        ok = false;
+        break;
+      }
+      present[j] = false;
+      inHeap--;
+    }
+  }
+  for (int i = 0; i < MAX_IDS; i++) {
+    if (present[i] && getPriority(heap, ids[i]) != priorities[i]) {
+      ok = false;
+    }
+  }
+  printf("%s: %d left, matches reference %s", label, heap->size,
+         ok && heap->size == inHeap ? "yes" : "no");
+  if (heap->idSlots != NULL) {
+    printf(", slots in use %s",
+           heap->usedSlots == heap->size ? "match" : "leak");
+  }
+  printf("\n");
+}
+
+/* Drains 'heap' and prints whether priorities came out in order. */
+void drain(const char* label, MinHeap* heap) {
+  int last = INT_MIN;
+  int count = 0;
+  bool sorted = true;
+  while (heap->size > 0) {
+    HeapNode node = extractMin(heap);
+    sorted = sorted && node.priority >= last;
+    last = node.priority;
+    count++;
+  }
+  printf("%s: drained %d in order %s\n", label, count, sorted ? "yes" : "no");
+}
+
+int main(void) {
+  int dense[MAX_IDS];
+  int sparse[MAX_IDS];
+  for (int i = 0; i < MAX_IDS; i++) {
+    dense[i] = i;
+    // large, scattered IDs, far beyond what a dense index could cover
+    sparse[i] = (int)(((long long)i * 7919 + 13) % 2000000000);
+  }
+
+  MinHeap* heap = newHeap(1);  // grows on demand
+  churn("binary heap", heap, dense, 1);
+  drain("binary heap", heap);
+  deleteHeap(heap);
+
+  for (int arity = 3; arity <= 8; arity += 5) {
+    char label[32];
+    snprintf(label, sizeof(label), "%d-ary heap", arity);
+    heap = newDaryHeap(16, arity);
+    churn(label, heap, dense, (unsigned int)arity);
+    drain(label, heap);
+    deleteHeap(heap);
+  }
+
+  heap = newSparseHeap(0);
+  churn("sparse heap", heap, sparse, 7);
+  drain("sparse heap", heap);
+  printf("sparse heap: empty table slots in use %d\n", heap->usedSlots);
+  deleteHeap(heap);
+
+  int priorities[MAX_IDS];
+  for (int i = 0; i < MAX_IDS; i++) {
+    priorities[i] = (i * 37) % 101;
+  }
+  heap = buildDaryHeap(priorities, dense, MAX_IDS, 4);
+  bool indexed = true;
+  for (int i = 0; i < MAX_IDS; i++) {
+    indexed = indexed && getPriority(heap, dense[i]) == priorities[i];
+  }
+  printf("built 4-ary heap: every ID indexed %s\n", indexed ? "yes" : "no");
+  drain("built 4-ary heap", heap);
+  deleteHeap(heap);
+  return 0;
+}